@@ -0,0 +1,38 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Average duration of a function in microseconds.
+ * @param iterations calls of the function
+ * @param function
+ * @return microseconds per call
+ */
+template<typename Function>
+static double measure(size_t iterations, Function function) {
+    const auto start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) function();
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / iterations;
+}
+
+/**
+ * Throughput of a function in MB/s of the processed data.
+ * @param size bytes processed by one call
+ * @param totalBytes bytes of the measurement, at least 10 calls are made
+ * @param function
+ * @return MB/s
+ */
+template<typename Function>
+static double measureThroughput(size_t size, size_t totalBytes, Function function) {
+    const size_t iterations = std::max<size_t>(totalBytes / size, 10);
+    const auto start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) function();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return (double) size * iterations / seconds / 1e6;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <openssl/pem.h>
+#include <src/Base64.h>
+#include "Benchmark.h"
+
+/**
+ * Compares the throughput of the base64 codec implementations with the former
+ * OpenSSL BIO chain at sizes from 16 B to 1 MB.
+ *
+ * Usage: ./base64Benchmark [bytes per measurement]
+ */
+
+/**
+ * Former encoder, that built a BIO chain for every call.
+ */
+static size_t bioEncode(const unsigned char *input, size_t length, char *output) {
+    BIO *bio = BIO_push(BIO_new(BIO_f_base64()), BIO_new(BIO_s_mem()));
+    BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
+    BIO_write(bio, input, (int) length);
+    BIO_flush(bio);
+    BUF_MEM *bufferPtr;
+    BIO_get_mem_ptr(bio, &bufferPtr);
+    memcpy(output, bufferPtr->data, bufferPtr->length);
+    size_t encodedLength = bufferPtr->length;
+    BIO_free_all(bio);
+    return encodedLength;
+}
+
+/**
+ * Former decoder, that built a BIO chain for every call.
+ */
+static long bioDecode(const char *input, size_t length, unsigned char *output) {
+    BIO *bio = BIO_push(BIO_new(BIO_f_base64()), BIO_new_mem_buf(input, (int) length));
+    BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
+    long decodedLength = BIO_read(bio, output, (int) length);
+    BIO_free_all(bio);
+    return decodedLength;
+}
+
+int main(int argc, char *argv[]) {
+    const size_t totalBytes = argc > 1 ? std::stoul(argv[1]) : 64 * 1024 * 1024;
+
+    struct Codec {
+        std::string name;
+        Base64::Implementation implementation;
+    };
+    std::vector<Codec> codecs;
+    for (const auto &codec : {Codec{"scalar", Base64::Implementation::SCALAR},
+                              Codec{"ssse3", Base64::Implementation::SSSE3},
+                              Codec{"avx2", Base64::Implementation::AVX2}}) {
+        if (Base64::isSupported(codec.implementation)) codecs.push_back(codec);
+    }
+
+    std::cout << "throughput in MB/s of binary data" << std::endl << std::setw(10) << "size" << std::setw(12)
+              << "bio enc" << std::setw(12) << "bio dec";
+    for (const auto &codec : codecs) {
+        std::cout << std::setw(12) << codec.name + " enc" << std::setw(12) << codec.name + " dec";
+    }
+    std::cout << std::endl << std::fixed << std::setprecision(0);
+
+    std::mt19937 random(42);
+    for (size_t size = 16; size <= 1024 * 1024; size *= 4) {
+        std::vector<unsigned char> data(size), decoded(size + 4);
+        for (auto &byte : data) byte = (unsigned char) random();
+        std::vector<char> encoded(Base64::encodedLength(size));
+        Base64::encode(data.data(), size, encoded.data());
+
+        std::cout << std::setw(10) << size
+                  << std::setw(12) << measureThroughput(size, totalBytes, [&]() {
+                      bioEncode(data.data(), size, encoded.data());
+                  })
+                  << std::setw(12) << measureThroughput(size, totalBytes, [&]() {
+                      bioDecode(encoded.data(), encoded.size(), decoded.data());
+                  });
+
+        for (const auto &codec : codecs) {
+            Base64::setImplementation(codec.implementation);
+            std::cout << std::setw(12) << measureThroughput(size, totalBytes, [&]() {
+                Base64::encode(data.data(), size, encoded.data());
+            }) << std::setw(12) << measureThroughput(size, totalBytes, [&]() {
+                Base64::decode(encoded.data(), encoded.size(), decoded.data());
+            });
+            if (Base64::decode(encoded.data(), encoded.size(), decoded.data()) != (long) size ||
+                memcmp(decoded.data(), data.data(), size) != 0) {
+                std::cerr << std::endl << codec.name << " failed the round trip." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        std::cout << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <regex>
+#include <vector>
+#include <src/CommandParser.h>
+#include <src/NicknameManager.h>
+#include <src/Helper.h>
+#include "Benchmark.h"
+
+/**
+ * Measures the parsing of scripted commands and nickname checks.
+ * "regex" is the former parsing, that compiled a regular expression for every command.
+ * Both have to accept the same commands and parse the same arguments.
+ *
+ * Usage: ./commandParserBenchmark [commands]
+ */
+
+// former validation of the commands
+#define COMMAND_REGEX R"(^/(quit|list|neighbors|plot|getkeypair|((leave|nick|gettopic|getmembers|getpublickey)\s+[\w\d]+)|((settopic|msg)\s+[\w\d]+\s+.+)|((route|help)\s*[\w\d]*)|(ping\s+[\w\d\:]+)|(join\s+[\w\d]+\s+[\w\d]+))$)"
+
+/**
+ * Former parsing of a valid command.
+ */
+static void parseFormer(std::string command, std::string &name, std::string &target, std::string &text) {
+    target.clear();
+    text.clear();
+    int pos = command.find(' ');
+    name = rtrim_copy(command.substr(1, pos));
+    if (pos == -1) return;
+    command.erase(0, pos + 1);
+    ltrim(command);
+    pos = command.find(' ');
+    target = rtrim_copy(command.substr(0, pos));
+    if (pos == -1) return;
+    command.erase(0, pos + 1);
+    ltrim(command);
+    text = command;
+}
+
+int main(int argc, char *argv[]) {
+    const size_t count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+
+    const std::vector<std::string> script = {
+            "/msg bob hello there, how are you?", "/MSG team   the build is green", "/join team secret",
+            "/leave team", "/nick alice2", "/list", "/neighbors", "/route bob", "/route", "/help msg", "/Help",
+            "/ping fe80::1", "/ping bob", "/settopic team release on friday", "/gettopic team", "/getmembers team",
+            "/getpublickey bob", "/getkeypair", "/quit", "/plot",
+            // invalid ones
+            "/msg bob", "/msg", "/join team", "/nick ali-ce", "/unknown", "msg bob hi", "/list all", "/quitnow",
+            "/routebob", "/ping fe80::1%eth0", "/join a b c", "/", "/ms bob hi", "/getkeypairs",
+    };
+    const std::string names = " quit list neighbors plot getkeypair leave nick gettopic getmembers getpublickey "
+                              "settopic msg route help ping join ";
+
+    // both parsers have to agree on every command of the script
+    const std::regex commandRegex(COMMAND_REGEX, std::regex::icase);
+    for (const auto &command : script) {
+        Type type = Type::INVALID;
+        std::string target, text, formerName, formerTarget, formerText;
+        CommandOptions options;
+        const bool valid = CommandParser::parse(command, type, target, text, options);
+        bool formerValid = std::regex_match(command, commandRegex);
+        if (formerValid) {
+            parseFormer(command, formerName, formerTarget, formerText);
+            // the regex also matched names glued to their argument, which were rejected as unknown type afterwards
+            for (auto &c : formerName) c = (char) tolower(c);
+            formerValid = names.find(' ' + formerName + ' ') != std::string::npos;
+        }
+        if (valid != formerValid || (valid && (target != formerTarget || text != formerText))) {
+            std::cerr << "The parsers disagree on '" << command << "'." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // compiling the regex takes long, thus the former parsing is measured less often
+    const size_t formerCount = std::max<size_t>(count / 500, 100);
+    std::string name, target, text;
+    Type type;
+    CommandOptions options;
+    size_t accepted = 0, acceptedNicknames = 0, next = 0;
+    const auto former = measure(formerCount, [&]() {
+        const std::string &command = script[next++ % script.size()];
+        std::regex regex;
+        regex.assign(COMMAND_REGEX, std::regex::icase);
+        if (std::regex_match(command, regex)) parseFormer(command, name, target, text);
+    });
+    next = 0;
+    const auto parser = measure(count, [&]() {
+        accepted += CommandParser::parse(script[next++ % script.size()], type, target, text, options);
+    });
+
+    const std::vector<std::string> nicknames = {"alice", "Bob42", "toolongnickname", "ali-ce", "", "x"};
+    next = 0;
+    const auto nickRegex = measure(formerCount, [&]() {
+        std::regex regex;
+        regex.assign(R"(^[A-Za-z0-9]{1,9}$)");
+        std::regex_match(nicknames[next++ % nicknames.size()], regex);
+    });
+    next = 0;
+    const auto nickCheck = measure(count, [&]() {
+        acceptedNicknames += NicknameManager::checkNickname(nicknames[next++ % nicknames.size()]);
+    });
+
+    std::cout << std::fixed << std::setprecision(3) << "commands: " << count << " (accepted " << accepted
+              << "), nicknames: " << count << " (accepted " << acceptedNicknames << ")"
+              << std::endl << std::setw(12) << "" << std::setw(14) << "regex (us)" << std::setw(14) << "parser (us)"
+              << std::endl << std::setw(12) << "command" << std::setw(14) << former << std::setw(14) << parser
+              << std::endl << std::setw(12) << "nickname" << std::setw(14) << nickRegex << std::setw(14) << nickCheck
+              << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,63 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <openssl/pem.h>
+#include <src/CryptoManager.h>
+#include "Benchmark.h"
+
+/**
+ * Measures the per message cost of the peer to peer encryption.
+ * Before the keys were cached, every encryption parsed the PEM public key of the target
+ * and every decryption the PEM private key. Both parses are measured separately and
+ * added to the cached cost to show the cost per message before and after.
+ *
+ * Usage: ./cryptoBenchmark [iterations] [message size]
+ */
+
+int main(int argc, char *argv[]) {
+    const int iterations = argc > 1 ? std::stoi(argv[1]) : 1000;
+    const size_t messageSize = argc > 2 ? std::stoul(argv[2]) : 256;
+
+    CryptoManager sender("sender");
+    CryptoManager receiver("receiver");
+    sender.add("receiver", receiver.get("receiver"));
+
+    const std::string message(messageSize, 'x');
+    const auto publicKey = receiver.get("receiver");
+    const auto &privateKey = receiver.getPrivateKey();
+    std::string encrypted;
+
+    const auto parsePublic = measure(iterations, [&]() {
+        BIO *publicBIO = BIO_new_mem_buf(publicKey.c_str(), -1);
+        EVP_PKEY *key = PEM_read_bio_PUBKEY(publicBIO, nullptr, nullptr, nullptr);
+        BIO_free_all(publicBIO);
+        EVP_PKEY_free(key);
+    });
+    const auto parsePrivate = measure(iterations, [&]() {
+        BIO *privateBIO = BIO_new_mem_buf(privateKey.c_str(), -1);
+        EVP_PKEY *key = PEM_read_bio_PrivateKey(privateBIO, nullptr, nullptr, nullptr);
+        BIO_free_all(privateBIO);
+        EVP_PKEY_free(key);
+    });
+    const auto encrypt = measure(iterations, [&]() {
+        encrypted = sender.publicEncrypt(message, "receiver");
+    });
+    const auto decrypt = measure(iterations, [&]() {
+        receiver.privateDecrypt(encrypted);
+    });
+
+    if (receiver.privateDecrypt(encrypted).compare(0, message.size(), message) != 0) {
+        std::cerr << "Decrypted message does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "message size: " << messageSize << " bytes, iterations: " << iterations << std::endl
+              << std::setw(10) << "" << std::setw(14) << "parse (us)" << std::setw(14) << "before (us)"
+              << std::setw(14) << "after (us)" << std::endl
+              << std::setw(10) << "encrypt" << std::setw(14) << parsePublic << std::setw(14)
+              << parsePublic + encrypt << std::setw(14) << encrypt << std::endl
+              << std::setw(10) << "decrypt" << std::setw(14) << parsePrivate << std::setw(14)
+              << parsePrivate + decrypt << std::setw(14) << decrypt << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <unistd.h>
+#include <src/CryptoManager.h>
+
+/**
+ * Sends messages through the crypto layer and tracks the resident set size.
+ * Every message is encrypted for a peer and for a group and decrypted by the group.
+ * Decrypting with the private key is slow, thus only every 100th message is decrypted by the peer.
+ * The resident set size has to stay flat after the scratch buffers reached their size.
+ *
+ * Usage: ./cryptoSoak [messages] [message size]
+ */
+
+/**
+ * Current resident set size of this process.
+ * @return kilobytes
+ */
+static long residentSetSize() {
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0, residentPages = 0;
+    statm >> pages >> residentPages;
+    return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char *argv[]) {
+    const long messages = argc > 1 ? std::stol(argv[1]) : 1000000;
+    const size_t messageSize = argc > 2 ? std::stoul(argv[2]) : 256;
+    const long reports = 10;
+
+    CryptoManager sender("sender");
+    CryptoManager receiver("receiver");
+    sender.add("receiver", receiver.get("receiver"));
+    sender.setGroupKey("group", "password");
+    receiver.setGroupKey("group", "password");
+
+    std::string message(messageSize, 'x');
+    std::string encrypted, decrypted;
+    long startRss = 0;
+
+    std::cout << std::setw(12) << "messages" << std::setw(12) << "rss (kB)" << std::endl;
+    for (long i = 1; i <= messages; ++i) {
+        message[i % messageSize] = (char) ('a' + i % 26);
+
+        if (!sender.publicEncrypt(message, "receiver", encrypted) ||
+            (i % 100 == 0 && !receiver.privateDecrypt(encrypted, decrypted))) {
+            std::cerr << "Peer encryption failed at message " << i << "." << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!sender.groupEncrypt(message, "group", encrypted) ||
+            !receiver.groupDecrypt(encrypted, "group", decrypted) ||
+            decrypted.compare(0, message.size(), message) != 0) {
+            std::cerr << "Group encryption failed at message " << i << "." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if (i == 1) startRss = residentSetSize();
+        if (i % (messages / reports == 0 ? 1 : messages / reports) == 0 || i == messages) {
+            std::cout << std::setw(12) << i << std::setw(12) << residentSetSize() << std::endl;
+        }
+    }
+
+    std::cout << "growth after the first message: " << residentSetSize() - startRss << " kB" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <src/CryptoWorkerPool.h>
+#include <src/Helper.h>
+
+/**
+ * Measures how opening and sealing peer envelopes scales with the number of crypto workers.
+ * The envelopes come from 64 origins, the messages of every origin have to be collected in order.
+ * "main" is the former processing on the main thread.
+ *
+ * Usage: ./cryptoWorkerBenchmark [messages] [rsa|x25519]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+#define ORIGINS 64
+
+int main(int argc, char *argv[]) {
+    const size_t messages = argc > 1 ? std::stoul(argv[1]) : 4000;
+    const KeyType keyType = argc > 2 && std::string(argv[2]) == "x25519" ? KeyType::X25519 : KeyType::RSA;
+
+    CryptoManager sender("sender", "", keyType);
+    CryptoManager receiver("receiver", "", keyType);
+    for (int i = 0; i < ORIGINS; ++i) sender.add("origin" + std::to_string(i), receiver.get("receiver"));
+
+    // every origin numbers its messages
+    std::vector<std::string> envelopes(messages);
+    for (size_t i = 0; i < messages; ++i) {
+        json message = {{"id", i}, {"origin", i % ORIGINS}, {"sequence", i / ORIGINS},
+                        {"payload", std::string(256, 'x')}};
+        sender.publicEncrypt(message.dump(), "origin" + std::to_string(i % ORIGINS), envelopes[i]);
+    }
+    const std::string plaintext = json{{"payload", std::string(256, 'x')}}.dump();
+
+    std::cout << "messages: " << messages << ", key type: " << (keyType == KeyType::RSA ? "rsa" : "x25519")
+              << ", cores: " << std::thread::hardware_concurrency() << std::endl
+              << std::setw(8) << "workers" << std::setw(14) << "open (msg/s)" << std::setw(14) << "seal (msg/s)"
+              << std::endl << std::fixed << std::setprecision(0);
+
+    // former processing on the main thread
+    {
+        std::string decrypted, encrypted;
+        auto start = Clock::now();
+        for (const auto &envelope : envelopes) {
+            receiver.privateDecrypt(envelope, decrypted);
+            tryParse(decrypted);
+        }
+        const double open = messages / std::chrono::duration<double>(Clock::now() - start).count();
+        start = Clock::now();
+        for (size_t i = 0; i < messages; ++i) sender.publicEncrypt(plaintext, "origin" + std::to_string(i % ORIGINS),
+                                                                   encrypted);
+        const double seal = messages / std::chrono::duration<double>(Clock::now() - start).count();
+        std::cout << std::setw(8) << "main" << std::setw(14) << open << std::setw(14) << seal << std::endl;
+    }
+
+    for (size_t workers = 1; workers <= 16; workers *= 2) {
+        std::vector<long> nextSequence(ORIGINS, 0);
+        size_t opened = 0, sealed = 0;
+        bool ordered = true;
+
+        CryptoWorkerPool openPool(receiver, workers, [&](CryptoJob &job) {
+            const int origin = job.message["origin"];
+            ordered = ordered && job.message["sequence"] == nextSequence[origin]++;
+            opened++;
+        });
+        auto start = Clock::now();
+        for (size_t i = 0; i < messages; ++i) {
+            CryptoJob &job = openPool.prepare(i % ORIGINS);
+            job.kind = CryptoJob::Kind::OPEN;
+            job.hostname = "origin" + std::to_string(i % ORIGINS);
+            job.envelope = envelopes[i];
+            openPool.submit();
+        }
+        openPool.wait();
+        const double open = messages / std::chrono::duration<double>(Clock::now() - start).count();
+
+        CryptoWorkerPool sealPool(sender, workers, [&](CryptoJob &job) { sealed += job.success; });
+        start = Clock::now();
+        for (size_t i = 0; i < messages; ++i) {
+            const std::string target = "origin" + std::to_string(i % ORIGINS);
+            CryptoJob &job = sealPool.prepare(hashString(target));
+            job.kind = CryptoJob::Kind::SEAL;
+            job.hostname = target;
+            job.plaintext = &plaintext;
+            sealPool.submit();
+        }
+        sealPool.wait();
+        const double seal = messages / std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (opened != messages || sealed != messages || !ordered) {
+            std::cerr << "Lost or reordered messages with " << workers << " workers." << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << std::setw(8) << workers << std::setw(14) << open << std::setw(14) << seal << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <openssl/evp.h>
+#include <src/CryptoManager.h>
+#include "Benchmark.h"
+
+/**
+ * Measures the throughput of the group encryption on one core.
+ * The former AES-256-CBC encryption, that set the key for every message, is measured for comparison.
+ *
+ * Usage: ./groupCryptoBenchmark [bytes per measurement]
+ */
+
+int main(int argc, char *argv[]) {
+    const size_t totalBytes = argc > 1 ? std::stoul(argv[1]) : 256 * 1024 * 1024;
+
+    CryptoManager sender("sender");
+    CryptoManager receiver("receiver");
+    sender.setGroupKey("group", "password");
+    receiver.setGroupKey("group", "password");
+
+    // former encryption
+    EVP_CIPHER_CTX *cbcContext = EVP_CIPHER_CTX_new();
+    unsigned char cbcKey[32] = {1}, cbcIv[16] = {2};
+
+    std::cout << "throughput in MB/s per core" << std::endl << std::setw(10) << "size" << std::setw(12) << "cbc enc"
+              << std::setw(12) << "gcm enc" << std::setw(12) << "gcm dec" << std::setw(12) << "text enc"
+              << std::setw(12) << "text dec" << std::endl << std::fixed << std::setprecision(0);
+
+    for (size_t size = 64; size <= 1024 * 1024; size *= 4) {
+        const std::string message(size, 'x');
+        std::string envelope, plaintext, text;
+        std::vector<unsigned char> cbcOutput(size + 32);
+        sender.groupEncrypt(message, "group", envelope);
+        text = sender.groupEncrypt(message, "group");
+
+        std::cout << std::setw(10) << size
+                  << std::setw(12) << measureThroughput(size, totalBytes, [&]() {
+                      int length = 0;
+                      EVP_EncryptInit_ex(cbcContext, EVP_aes_256_cbc(), nullptr, cbcKey, cbcIv);
+                      EVP_EncryptUpdate(cbcContext, cbcOutput.data(), &length,
+                                        (const unsigned char *) message.data(), (int) size);
+                      EVP_EncryptFinal_ex(cbcContext, cbcOutput.data() + length, &length);
+                  })
+                  << std::setw(12) << measureThroughput(size, totalBytes, [&]() {
+                      sender.groupEncrypt(message, "group", envelope);
+                  })
+                  << std::setw(12) << measureThroughput(size, totalBytes, [&]() {
+                      receiver.groupDecrypt(envelope, "group", plaintext);
+                  })
+                  << std::setw(12) << measureThroughput(size, totalBytes, [&]() {
+                      text = sender.groupEncrypt(message, "group");
+                  })
+                  << std::setw(12) << measureThroughput(size, totalBytes, [&]() {
+                      plaintext = receiver.groupDecrypt(text, "group");
+                  }) << std::endl;
+
+        if (!receiver.groupDecrypt(envelope, "group", plaintext) || plaintext != message) {
+            std::cerr << "Group decryption failed." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    EVP_CIPHER_CTX_free(cbcContext);
+    return EXIT_SUCCESS;
+}
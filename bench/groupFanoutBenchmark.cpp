@@ -0,0 +1,66 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <src/CryptoManager.h>
+#include <src/Helper.h>
+#include "Benchmark.h"
+
+/**
+ * Measures the crypto of a relay that forwards a group message to its tree neighbors.
+ * "per hop" is the former forwarding: the envelope is opened and sealed again for every next hop.
+ * "frame" is the signed group frame: its signature is checked once and it is forwarded unchanged.
+ *
+ * Usage: ./groupFanoutBenchmark [iterations] [message size]
+ */
+
+int main(int argc, char *argv[]) {
+    const int iterations = argc > 1 ? std::stoi(argv[1]) : 200;
+    const size_t messageSize = argc > 2 ? std::stoul(argv[2]) : 256;
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "relay crypto per group message in us, message size: " << messageSize << " bytes" << std::endl
+              << std::setw(8) << "" << std::setw(12) << "next hops" << std::setw(12) << "per hop" << std::setw(12)
+              << "frame" << std::endl;
+
+    for (const auto keyType : {KeyType::RSA, KeyType::X25519}) {
+        CryptoManager origin("origin", "", keyType);
+        CryptoManager relay("relay", "", keyType);
+        relay.add("origin", origin.get("origin"));
+        origin.add("relay", relay.get("relay"));
+        origin.setGroupKey("group", "password");
+
+        const json header = {{"id", "origin-1"}, {"origin", "origin"}, {"timestamp", 0}, {"proposal", false},
+                             {"type", 0}, {"payload", {{"target", "group"}}}};
+        json message = header;
+        message["payload"]["text"] = origin.groupEncrypt(std::string(messageSize, 'x'), "group");
+        std::string envelope, frame, decrypted, sealed;
+        origin.publicEncrypt(message.dump(), "relay", envelope);
+        origin.sealGroupFrame(header.dump(), std::string(messageSize, 'x'), "group", frame);
+
+        json opened;
+        if (!relay.openPeerMessage(frame, decrypted, opened) ||
+            origin.groupDecrypt((std::string) opened["payload"]["text"], "group") != std::string(messageSize, 'x')) {
+            std::cerr << "Opening the group frame failed." << std::endl;
+            return EXIT_FAILURE;
+        }
+        frame.back() ^= 1;
+        if (relay.openPeerMessage(frame, decrypted, opened)) {
+            std::cerr << "A changed group frame was accepted." << std::endl;
+            return EXIT_FAILURE;
+        }
+        frame.back() ^= 1;
+
+        for (int nextHops = 1; nextHops <= 8; nextHops *= 2) {
+            for (int i = 0; i < nextHops; ++i) relay.add("hop" + std::to_string(i), origin.get("origin"));
+            const auto perHop = measure(iterations, [&]() {
+                relay.openPeerMessage(envelope, decrypted, opened);
+                const std::string plaintext = opened.dump();
+                for (int i = 0; i < nextHops; ++i) relay.publicEncrypt(plaintext, "hop" + std::to_string(i), sealed);
+            });
+            const auto signedFrame = measure(iterations, [&]() { relay.openPeerMessage(frame, decrypted, opened); });
+            std::cout << std::setw(8) << (keyType == KeyType::RSA ? "rsa" : "x25519") << std::setw(12) << nextHops
+                      << std::setw(12) << perHop << std::setw(12) << signedFrame << std::endl;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <src/CryptoManager.h>
+#include "Benchmark.h"
+
+/**
+ * Compares the RSA and the X25519 key type: key generation, peer envelopes, signatures
+ * and the size of the public keys in the INIT snapshot of a network.
+ *
+ * Usage: ./keyTypeBenchmark [iterations] [message size] [peers in the snapshot]
+ */
+
+int main(int argc, char *argv[]) {
+    const int iterations = argc > 1 ? std::stoi(argv[1]) : 1000;
+    const size_t messageSize = argc > 2 ? std::stoul(argv[2]) : 256;
+    const int peers = argc > 3 ? std::stoi(argv[3]) : 1000;
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "message size: " << messageSize << " bytes, iterations: " << iterations << std::endl
+              << std::setw(8) << "" << std::setw(12) << "keygen (us)" << std::setw(14) << "encrypt (us)"
+              << std::setw(14) << "decrypt (us)" << std::setw(12) << "sign (us)" << std::setw(12) << "verify (us)"
+              << std::setw(12) << "envelope" << std::setw(12) << "public key" << std::setw(12) << "snapshot"
+              << std::endl;
+
+    for (const auto keyType : {KeyType::RSA, KeyType::X25519}) {
+        // key generation is slow for RSA, thus it is measured less often
+        const int keygenIterations = std::max(iterations / 50, 1);
+        const auto keygen = measure(keygenIterations, [&]() { CryptoManager crypto("peer", "", keyType); });
+
+        CryptoManager sender("sender", "", keyType);
+        CryptoManager receiver("receiver", "", keyType);
+        sender.add("receiver", receiver.get("receiver"));
+        receiver.add("sender", sender.get("sender"));
+
+        const std::string message(messageSize, 'x');
+        std::string encrypted, decrypted, signature;
+        const auto encrypt = measure(iterations, [&]() { sender.publicEncrypt(message, "receiver", encrypted); });
+        const auto decrypt = measure(iterations, [&]() { receiver.privateDecrypt(encrypted, decrypted); });
+        const auto sign = measure(iterations, [&]() { sender.sign(message, signature); });
+        const auto verify = measure(iterations, [&]() { receiver.verify("sender", message, signature); });
+
+        if (!receiver.privateDecrypt(encrypted, decrypted) || decrypted != message ||
+            !receiver.verify("sender", message, signature)) {
+            std::cerr << "Decryption or verification failed." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // the INIT snapshot carries the public keys of all peers
+        CryptoManager snapshot("snapshot", "", keyType);
+        for (int i = 0; i < peers; ++i) snapshot.add("peer" + std::to_string(i), sender.get("sender"));
+
+        std::cout << std::setw(8) << (keyType == KeyType::RSA ? "rsa" : "x25519") << std::setw(12) << keygen
+                  << std::setw(14) << encrypt << std::setw(14) << decrypt << std::setw(12) << sign
+                  << std::setw(12) << verify << std::setw(12) << encrypted.size() - messageSize
+                  << std::setw(12) << sender.get("sender").size() << std::setw(12) << snapshot.toJson().dump().size()
+                  << std::endl;
+    }
+    std::cout << "envelope: overhead in bytes, snapshot: bytes of the public keys of " << peers << " peers"
+              << std::endl;
+    return EXIT_SUCCESS;
+}
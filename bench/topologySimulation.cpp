@@ -0,0 +1,134 @@
+#include <iostream>
+#include <iomanip>
+#include <queue>
+#include <random>
+#include <src/Topology.h>
+
+/**
+ * Simulates joins and leaves with the Topology join and leave rules and reports
+ * the degree, the diameter and the average path length of the resulting overlay.
+ *
+ * Usage: ./topologySimulation [max peers] [leave percentage]
+ */
+
+struct Metrics {
+    size_t maxDegree = 0;
+    int diameter = 0;
+    double averagePathLength = 0;
+    bool connected = true;
+};
+
+/**
+ * Breadth first search from every peer over the current topology.
+ */
+static Metrics measure(Topology &topology) {
+    // map hostnames to indices to keep the search cheap
+    json j = topology.toJson();
+    std::map<std::string, int> indices;
+    for (const auto &item : j.items()) indices.emplace(item.value()["hostname"], indices.size());
+    std::vector<std::vector<int>> adjacency(indices.size());
+    for (const auto &item : j.items()) {
+        auto &neighbors = adjacency[indices[item.value()["hostname"]]];
+        for (const auto &neighbor : item.value()["neighbors"]) neighbors.push_back(indices[neighbor]);
+    }
+
+    Metrics metrics;
+    unsigned long long pathLengths = 0, paths = 0;
+    std::vector<int> distance(adjacency.size());
+    std::vector<int> queue(adjacency.size());
+    for (size_t start = 0; start < adjacency.size(); ++start) {
+        metrics.maxDegree = std::max(metrics.maxDegree, adjacency[start].size());
+        std::fill(distance.begin(), distance.end(), -1);
+        size_t head = 0, tail = 0;
+        distance[start] = 0;
+        queue[tail++] = start;
+        while (head < tail) {
+            int current = queue[head++];
+            for (int neighbor : adjacency[current]) {
+                if (distance[neighbor] != -1) continue;
+                distance[neighbor] = distance[current] + 1;
+                metrics.diameter = std::max(metrics.diameter, distance[neighbor]);
+                pathLengths += distance[neighbor];
+                paths++;
+                queue[tail++] = neighbor;
+            }
+        }
+        if (tail != adjacency.size()) metrics.connected = false;
+    }
+    metrics.averagePathLength = paths == 0 ? 0 : (double) pathLengths / paths;
+    return metrics;
+}
+
+/**
+ * Integrate a new peer like Client::processMulticastMessage and Client::receiveNetworkData do.
+ */
+static void join(Topology &topology, const std::string &hostname) {
+    auto bridge = topology.calculateBridgePeer(hostname);
+    topology.addPeer(hostname);
+    for (const auto &connection : bridge.replacedConnections) {
+        topology.setConnection(connection[0], connection[1], false);
+    }
+    for (const auto &peer : bridge.peers) {
+        topology.setConnection(hostname, peer, true);
+    }
+}
+
+/**
+ * Remove a peer like Client::handlePeerCommandRemovePeer does.
+ * @return count of new connections
+ */
+static size_t leave(Topology &topology, const std::string &hostname) {
+    auto formerNeighbors = topology.getNeighbors(hostname);
+    topology.removePeer(hostname);
+    auto repairConnections = topology.calculateLeaveRepair(formerNeighbors);
+    for (const auto &connection : repairConnections) {
+        topology.setConnection(connection[0], connection[1], true);
+    }
+    return repairConnections.size();
+}
+
+static void printRow(const std::string &phase, int peerCount, const Metrics &metrics) {
+    std::cout << std::left << std::setw(8) << phase << std::right
+              << std::setw(8) << peerCount
+              << std::setw(12) << metrics.maxDegree
+              << std::setw(10) << metrics.diameter
+              << std::setw(14) << std::fixed << std::setprecision(2) << metrics.averagePathLength
+              << std::setw(12) << (metrics.connected ? "yes" : "no") << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    int maxPeers = argc > 1 ? std::stoi(argv[1]) : 10000;
+    int leavePercentage = argc > 2 ? std::stoi(argv[2]) : 20;
+
+    std::cout << std::left << std::setw(8) << "phase" << std::right << std::setw(8) << "peers"
+              << std::setw(12) << "max degree" << std::setw(10) << "diameter"
+              << std::setw(14) << "avg. path" << std::setw(12) << "connected" << std::endl;
+
+    Topology topology("peer0");
+    std::vector<std::string> hostnames{"peer0"};
+    int checkpoint = 10;
+    for (int i = 1; i < maxPeers; ++i) {
+        hostnames.push_back("peer" + std::to_string(i));
+        join(topology, hostnames.back());
+        if (i + 1 == checkpoint || i + 1 == maxPeers) {
+            printRow("join", topology.getPeerCount(), measure(topology));
+            checkpoint *= 10;
+        }
+    }
+
+    // let random peers leave, except the center of the topology
+    std::mt19937 random(42);
+    std::shuffle(hostnames.begin() + 1, hostnames.end(), random);
+    int leaves = maxPeers * leavePercentage / 100;
+    size_t repairConnections = 0;
+    for (int i = 0; i < leaves; ++i) {
+        repairConnections += leave(topology, hostnames.at(hostnames.size() - 1 - i));
+    }
+    if (leaves > 0) {
+        printRow("leave", topology.getPeerCount(), measure(topology));
+        std::cout << "New connections per leave: " << std::setprecision(2) << (double) repairConnections / leaves
+                  << std::endl;
+    }
+
+    return 0;
+}
@@ -11,6 +11,10 @@ int main(int argc, char *argv[]) {
             ("m,multicastPort", "Multicast Port", cxxopts::value<int>()->default_value(std::to_string(MULTICAST_PORT)))
             ("p,peerPort", "Peer Port", cxxopts::value<int>()->default_value(std::to_string(PEER_PORT)))
             ("n,nickname", "Custom nickname", cxxopts::value<std::string>())
+            ("k,keyfile", "File of the key pair, created on the first start", cxxopts::value<std::string>())
+            ("t,keytype", "Key type: rsa or x25519", cxxopts::value<std::string>()->default_value("rsa"))
+            ("b,binarylog", "Write the traces to a binary log file for logDecoder", cxxopts::value<std::string>())
+            ("s,statsfile", "Write the metrics to a Prometheus text file", cxxopts::value<std::string>())
             ("h,help", "Print usage");
 
     auto result = options.parse(argc, argv);
@@ -42,7 +46,29 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    Client client(result["d"].as<bool>(), multicastPort, peerPort, nickname);
+    std::string keyFile;
+    if (result.count("k")) keyFile = result["k"].as<std::string>();
+
+    KeyType keyType;
+    if (result["t"].as<std::string>() == "rsa") {
+        keyType = KeyType::RSA;
+    } else if (result["t"].as<std::string>() == "x25519") {
+        keyType = KeyType::X25519;
+    } else {
+        std::cout << "Invalid key type passed. Must be rsa or x25519" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // the binary log has to be opened before any other thread logs
+    if (result.count("b") && !Logger::getInstance().openBinaryLog(result["b"].as<std::string>())) {
+        std::cout << "Failed to create the binary log file." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::string statsFile;
+    if (result.count("s")) statsFile = result["s"].as<std::string>();
+
+    Client client(result["d"].as<bool>(), multicastPort, peerPort, nickname, keyFile, keyType, statsFile);
     std::mutex consoleMutex;
 
     // thread to process the input
@@ -60,9 +86,10 @@ int main(int argc, char *argv[]) {
         }
     }};
 
-    // thread to process the output
+    // thread to process the output, sleeps while there is none
     std::thread outputThread{[&] {
         while (true) {
+            client.waitForOutput();
             while (client.hasOutput()) {
                 std::lock_guard<std::mutex> lockGuard(consoleMutex);
                 std::cout << client.popOutputMessage() << std::endl;
@@ -0,0 +1,378 @@
+#include "Base64.h"
+#include <array>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86
+#include <immintrin.h>
+#endif
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Build the table from characters to their 6 bit values. Invalid characters are 0xFF.
+ */
+static std::array<unsigned char, 256> buildDecodeTable() {
+    std::array<unsigned char, 256> table{};
+    table.fill(0xFF);
+    for (unsigned char i = 0; i < 64; ++i) table[(unsigned char) alphabet[i]] = i;
+    return table;
+}
+
+static const std::array<unsigned char, 256> decodeTable = buildDecodeTable();
+
+Base64::Implementation Base64::implementation = Base64::detectImplementation();
+
+/**
+ * Get the length of the encoded data including the padding.
+ * @param length of the binary data
+ * @return length of the base64 string
+ */
+size_t Base64::encodedLength(size_t length) {
+    return (length + 2) / 3 * 4;
+}
+
+/**
+ * Get the length of the decoded data.
+ * @param input base64 string
+ * @param length of the base64 string
+ * @return length of the binary data, if the string is valid
+ */
+size_t Base64::decodedLength(const char *input, size_t length) {
+    for (int padding = 0; padding < 2 && length > 0 && input[length - 1] == '='; ++padding) length--;
+    return length / 4 * 3 + (length % 4 == 0 ? 0 : length % 4 - 1);
+}
+
+/**
+ * Encode binary data to base64 with padding.
+ * @param input binary data
+ * @param length of the binary data
+ * @param output has to hold encodedLength(length) characters. It is not null terminated.
+ * @return count of written characters
+ */
+size_t Base64::encode(const unsigned char *input, size_t length, char *output) {
+    switch (implementation) {
+        case Implementation::AVX2:
+            return encodeAvx2(input, length, output);
+        case Implementation::SSSE3:
+            return encodeSsse3(input, length, output);
+        default:
+            return encodeScalar(input, length, output);
+    }
+}
+
+/**
+ * Decode a base64 string. The padding is optional.
+ * @param input base64 string
+ * @param length of the base64 string
+ * @param output has to hold decodedLength(input, length) bytes
+ * @return count of written bytes or -1 if the string is invalid
+ */
+long Base64::decode(const char *input, size_t length, unsigned char *output) {
+    // strip the padding
+    for (int padding = 0; padding < 2 && length > 0 && input[length - 1] == '='; ++padding) length--;
+    if (length % 4 == 1) return -1;
+
+    switch (implementation) {
+        case Implementation::AVX2:
+            return decodeAvx2(input, length, output);
+        case Implementation::SSSE3:
+            return decodeSsse3(input, length, output);
+        default:
+            return decodeScalar(input, length, output);
+    }
+}
+
+/**
+ * Select the implementation, e.g. to compare them.
+ * @param implementation
+ * @return false if the CPU does not support it
+ */
+bool Base64::setImplementation(Implementation implementation) {
+    if (!isSupported(implementation)) return false;
+    Base64::implementation = implementation;
+    return true;
+}
+
+/**
+ * Check if the CPU supports an implementation.
+ * @param implementation
+ * @return true if supported
+ */
+bool Base64::isSupported(Implementation implementation) {
+    switch (implementation) {
+        case Implementation::AVX2:
+            return detectImplementation() == Implementation::AVX2;
+        case Implementation::SSSE3:
+            return detectImplementation() != Implementation::SCALAR;
+        default:
+            return true;
+    }
+}
+
+/**
+ * Get the fastest implementation the CPU supports.
+ * @return implementation
+ */
+Base64::Implementation Base64::detectImplementation() {
+#ifdef BASE64_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Implementation::AVX2;
+    if (__builtin_cpu_supports("ssse3")) return Implementation::SSSE3;
+#endif
+    return Implementation::SCALAR;
+}
+
+#pragma region Scalar
+
+/**
+ * Encode 3 bytes to 4 characters at a time.
+ */
+size_t Base64::encodeScalar(const unsigned char *input, size_t length, char *output) {
+    size_t i = 0, o = 0;
+    for (; i + 3 <= length; i += 3) {
+        uint32_t value = input[i] << 16 | input[i + 1] << 8 | input[i + 2];
+        output[o++] = alphabet[value >> 18 & 63];
+        output[o++] = alphabet[value >> 12 & 63];
+        output[o++] = alphabet[value >> 6 & 63];
+        output[o++] = alphabet[value & 63];
+    }
+
+    if (i < length) {
+        uint32_t value = input[i] << 16 | (i + 1 < length ? input[i + 1] << 8 : 0);
+        output[o++] = alphabet[value >> 18 & 63];
+        output[o++] = alphabet[value >> 12 & 63];
+        output[o++] = i + 1 < length ? alphabet[value >> 6 & 63] : '=';
+        output[o++] = '=';
+    }
+    return o;
+}
+
+/**
+ * Decode 4 characters to 3 bytes at a time. The padding has to be stripped.
+ */
+long Base64::decodeScalar(const char *input, size_t length, unsigned char *output) {
+    size_t i = 0, o = 0;
+    for (; i + 4 <= length; i += 4) {
+        uint32_t a = decodeTable[(unsigned char) input[i]], b = decodeTable[(unsigned char) input[i + 1]];
+        uint32_t c = decodeTable[(unsigned char) input[i + 2]], d = decodeTable[(unsigned char) input[i + 3]];
+        if ((a | b | c | d) & 0x80) return -1;
+        uint32_t value = a << 18 | b << 12 | c << 6 | d;
+        output[o++] = value >> 16;
+        output[o++] = value >> 8;
+        output[o++] = value;
+    }
+
+    // 2 or 3 remaining characters without padding
+    if (i < length) {
+        uint32_t a = decodeTable[(unsigned char) input[i]], b = decodeTable[(unsigned char) input[i + 1]];
+        uint32_t c = i + 2 < length ? decodeTable[(unsigned char) input[i + 2]] : 0;
+        if ((a | b | c) & 0x80) return -1;
+        uint32_t value = a << 18 | b << 12 | c << 6;
+        output[o++] = value >> 16;
+        if (i + 2 < length) output[o++] = value >> 8;
+    }
+    return o;
+}
+
+#pragma endregion
+
+#ifdef BASE64_X86
+
+#pragma region SSSE3
+
+// the blocks are inlined into the AVX2 functions as well, where they are VEX encoded and thus avoid the
+// penalty of switching between AVX and SSE instructions
+#define BASE64_SSSE3_BLOCK __attribute__((target("ssse3"), always_inline)) static inline
+
+/**
+ * Encode 12 bytes to 16 characters. Reads 16 bytes.
+ * The bytes are spread to one 6 bit index per byte with multiplications and mapped to characters
+ * by adding an offset that depends on the range of the index.
+ */
+BASE64_SSSE3_BLOCK void encodeBlockSsse3(const unsigned char *input, char *output) {
+    __m128i in = _mm_loadu_si128((const __m128i *) input);
+    // bytes s0 s1 s2 to s1 s0 s2 s1
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    // move the 6 bit indices to their own bytes
+    const __m128i first = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+                                          _mm_set1_epi32(0x04000040));
+    const __m128i second = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+                                           _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(first, second);
+
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    const __m128i characters = _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+    _mm_storeu_si128((__m128i *) output, characters);
+}
+
+/**
+ * Decode 16 characters to 12 bytes. Writes 16 bytes.
+ * The characters are validated and mapped by their ranges and the 6 bit values are packed with multiplications.
+ * @return false if a character is invalid
+ */
+BASE64_SSSE3_BLOCK bool decodeBlockSsse3(const char *input, unsigned char *output) {
+    const __m128i in = _mm_loadu_si128((const __m128i *) input);
+    const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)),
+                                        _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), in));
+    const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)),
+                                        _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), in));
+    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)),
+                                        _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), in));
+    const __m128i plus = _mm_cmpeq_epi8(in, _mm_set1_epi8('+'));
+    const __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, plus), slash));
+    if (_mm_movemask_epi8(valid) != 0xFFFF) return false;
+
+    const __m128i offsets = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65)), _mm_and_si128(lower, _mm_set1_epi8(-71))),
+            _mm_or_si128(_mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(4)),
+                                      _mm_and_si128(plus, _mm_set1_epi8(19))),
+                         _mm_and_si128(slash, _mm_set1_epi8(16))));
+    const __m128i values = _mm_add_epi8(in, offsets);
+
+    // a b c d to 24 bit values, then drop the empty fourth byte of every 32 bit
+    __m128i packed = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    packed = _mm_madd_epi16(packed, _mm_set1_epi32(0x00011000));
+    packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    _mm_storeu_si128((__m128i *) output, packed);
+    return true;
+}
+
+/**
+ * Encode 12 bytes to 16 characters at a time.
+ */
+__attribute__((target("ssse3")))
+size_t Base64::encodeSsse3(const unsigned char *input, size_t length, char *output) {
+    size_t i = 0, o = 0;
+    // every 16 byte load only uses 12 bytes
+    for (; i + 16 <= length; i += 12, o += 16) encodeBlockSsse3(input + i, output + o);
+    return o + encodeScalar(input + i, length - i, output + o);
+}
+
+/**
+ * Decode 16 characters to 12 bytes at a time. The padding has to be stripped.
+ */
+__attribute__((target("ssse3")))
+long Base64::decodeSsse3(const char *input, size_t length, unsigned char *output) {
+    size_t i = 0, o = 0;
+    // every 16 byte store only writes 12 bytes, thus enough input has to remain
+    for (; i + 24 <= length; i += 16, o += 12) {
+        if (!decodeBlockSsse3(input + i, output + o)) return -1;
+    }
+
+    long rest = decodeScalar(input + i, length - i, output + o);
+    return rest < 0 ? -1 : o + rest;
+}
+
+#pragma endregion
+
+#pragma region AVX2
+
+/**
+ * Encode 24 bytes to 32 characters at a time, with the same steps as encodeSsse3 in both 128 bit lanes.
+ */
+__attribute__((target("avx2")))
+size_t Base64::encodeAvx2(const unsigned char *input, size_t length, char *output) {
+    size_t i = 0, o = 0;
+    // the second 16 byte load starts at byte 12 and only uses 12 bytes
+    for (; i + 28 <= length; i += 24, o += 32) {
+        __m256i in = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (input + i))),
+                _mm_loadu_si128((const __m128i *) (input + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                                     10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        const __m256i first = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)),
+                                                 _mm256_set1_epi32(0x04000040));
+        const __m256i second = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)),
+                                                  _mm256_set1_epi32(0x01000010));
+        const __m256i indices = _mm256_or_si256(first, second);
+
+        __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices),
+                                                        _mm256_set1_epi8(13)));
+        const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                                 '/' - 63, 'A', 0, 0,
+                                                 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                                 '/' - 63, 'A', 0, 0);
+        const __m256i characters = _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), indices);
+        _mm256_storeu_si256((__m256i *) (output + o), characters);
+    }
+    for (; i + 16 <= length; i += 12, o += 16) encodeBlockSsse3(input + i, output + o);
+    return o + encodeScalar(input + i, length - i, output + o);
+}
+
+/**
+ * Decode 32 characters to 24 bytes at a time, with the same steps as decodeSsse3 in both 128 bit lanes.
+ */
+__attribute__((target("avx2")))
+long Base64::decodeAvx2(const char *input, size_t length, unsigned char *output) {
+    size_t i = 0, o = 0;
+    // every 32 byte store only writes 24 bytes, thus enough input has to remain
+    for (; i + 48 <= length; i += 32, o += 24) {
+        const __m256i in = _mm256_loadu_si256((const __m256i *) (input + i));
+        const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('A' - 1)),
+                                               _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), in));
+        const __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('a' - 1)),
+                                               _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), in));
+        const __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('0' - 1)),
+                                               _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), in));
+        const __m256i plus = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('+'));
+        const __m256i slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+        const __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+                                              _mm256_or_si256(_mm256_or_si256(digit, plus), slash));
+        if (_mm256_movemask_epi8(valid) != -1) return -1;
+
+        const __m256i offsets = _mm256_or_si256(
+                _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-65)),
+                                _mm256_and_si256(lower, _mm256_set1_epi8(-71))),
+                _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(4)),
+                                                _mm256_and_si256(plus, _mm256_set1_epi8(19))),
+                                _mm256_and_si256(slash, _mm256_set1_epi8(16))));
+        const __m256i values = _mm256_add_epi8(in, offsets);
+
+        __m256i packed = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        packed = _mm256_madd_epi16(packed, _mm256_set1_epi32(0x00011000));
+        packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        // move the 12 bytes of both lanes together
+        packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256((__m256i *) (output + o), packed);
+    }
+
+    for (; i + 24 <= length; i += 16, o += 12) {
+        if (!decodeBlockSsse3(input + i, output + o)) return -1;
+    }
+
+    long rest = decodeScalar(input + i, length - i, output + o);
+    return rest < 0 ? -1 : o + rest;
+}
+
+#pragma endregion
+
+#else
+
+// without x86 SIMD the scalar implementation is used
+size_t Base64::encodeSsse3(const unsigned char *input, size_t length, char *output) {
+    return encodeScalar(input, length, output);
+}
+
+long Base64::decodeSsse3(const char *input, size_t length, unsigned char *output) {
+    return decodeScalar(input, length, output);
+}
+
+size_t Base64::encodeAvx2(const unsigned char *input, size_t length, char *output) {
+    return encodeScalar(input, length, output);
+}
+
+long Base64::decodeAvx2(const char *input, size_t length, unsigned char *output) {
+    return decodeScalar(input, length, output);
+}
+
+#endif
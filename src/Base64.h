@@ -0,0 +1,37 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <cstddef>
+
+// base64 codec without newlines. Uses SSSE3 or AVX2 if the CPU supports it.
+class Base64 {
+public:
+    enum class Implementation {
+        SCALAR,
+        SSSE3,
+        AVX2
+    };
+
+    static size_t encodedLength(size_t length);
+    static size_t decodedLength(const char *input, size_t length);
+    static size_t encode(const unsigned char *input, size_t length, char *output);
+    static long decode(const char *input, size_t length, unsigned char *output);
+
+    // getter & setter
+    static Implementation getImplementation() { return implementation; }
+    static bool setImplementation(Implementation implementation);
+    static bool isSupported(Implementation implementation);
+
+private:
+    static Implementation implementation;
+
+    static Implementation detectImplementation();
+    static size_t encodeScalar(const unsigned char *input, size_t length, char *output);
+    static long decodeScalar(const char *input, size_t length, unsigned char *output);
+    static size_t encodeSsse3(const unsigned char *input, size_t length, char *output);
+    static long decodeSsse3(const char *input, size_t length, unsigned char *output);
+    static size_t encodeAvx2(const unsigned char *input, size_t length, char *output);
+    static long decodeAvx2(const char *input, size_t length, unsigned char *output);
+};
+
+#endif
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "BinaryLog.h"
+#include "Logger.h"
+
+static_assert(sizeof(BinaryLogRecord) == BINARY_LOG_RECORD_SIZE, "records have a fixed size");
+static_assert(sizeof(BinaryLogHeader) == 4096, "the records start on a page");
+
+// formats of the traces, in the order of TraceFormat
+static const char *const formats[] = {
+        "Received message {} of type {} from '{}' over '{}'.",
+        "Received multicast message from '{}'.",
+        "Latency to peer (Hostname: '{}') changed to {}us.",
+        "Closed connection to peer (Hostname: '{}').",
+        "Removed connection between '{}' and '{}'.",
+        "Added new peer (Hostname: '{}').",
+};
+static_assert(sizeof(formats) / sizeof(formats[0]) == (size_t) TraceFormat::COUNT, "every trace has a format");
+
+#pragma region Constructor
+
+/**
+ * Create the log file and start the background thread. The file is overwritten.
+ * @param path of the file
+ */
+BinaryLog::BinaryLog(const std::string &path) : slots(new Slot[BINARY_LOG_QUEUE_LENGTH]) {
+    for (size_t i = 0; i < BINARY_LOG_QUEUE_LENGTH; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    mappedSize = sizeof(BinaryLogHeader) + (size_t) BINARY_LOG_RECORDS * sizeof(BinaryLogRecord);
+    void *mapped = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, (off_t) mappedSize) == 0) {
+        mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (fd >= 0) close(fd);
+    if (mapped == MAP_FAILED) {
+        Logger::getInstance().log("Failed to create the binary log '" + path + "'.", LogType::ERROR);
+        return;
+    }
+
+    header = static_cast<BinaryLogHeader *>(mapped);
+    records = reinterpret_cast<BinaryLogRecord *>(header + 1);
+    memcpy(header->magic, BINARY_LOG_MAGIC, sizeof(header->magic));
+    header->recordSize = sizeof(BinaryLogRecord);
+    header->formatCount = (uint32_t) TraceFormat::COUNT;
+    header->capacity = BINARY_LOG_RECORDS;
+    size_t offset = 0;
+    for (const char *format : formats) {
+        const size_t length = strlen(format) + 1;
+        memcpy(header->formats + offset, format, length);
+        offset += length;
+    }
+
+    thread = std::thread(&BinaryLog::run, this);
+}
+
+/**
+ * Write the queued records and close the file.
+ */
+BinaryLog::~BinaryLog() {
+    if (header == nullptr) return;
+    running = false;
+    thread.join();
+    flush();
+    msync(header, mappedSize, MS_SYNC);
+    munmap(header, mappedSize);
+}
+
+#pragma endregion
+
+/**
+ * Queue a record. Never blocks, the record is dropped if the queue is full.
+ * @param record
+ */
+void BinaryLog::push(const BinaryLogRecord &record) {
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+        slot = &slots[position & (BINARY_LOG_QUEUE_LENGTH - 1)];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        } else if (sequence < position) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+    // only the used bytes of the arguments are copied
+    memcpy(&slot->record, &record, offsetof(BinaryLogRecord, arguments) + record.length);
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+/**
+ * Loop of the background thread. The records are written in batches, thus the producers never wake it.
+ */
+void BinaryLog::run() {
+    while (running.load(std::memory_order_relaxed)) {
+        if (!flush()) std::this_thread::sleep_for(std::chrono::milliseconds(BINARY_LOG_FLUSH_INTERVAL));
+    }
+}
+
+/**
+ * Copy the queued records into the ring of the file.
+ * @return true if there were some
+ */
+bool BinaryLog::flush() {
+    uint64_t written = header->written;
+    const uint64_t start = written;
+    while (true) {
+        Slot &slot = slots[dequeuePosition & (BINARY_LOG_QUEUE_LENGTH - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) break;
+
+        BinaryLogRecord &target = records[written % BINARY_LOG_RECORDS];
+        memcpy(&target, &slot.record, offsetof(BinaryLogRecord, arguments) + slot.record.length);
+        written++;
+        slot.sequence.store(dequeuePosition + BINARY_LOG_QUEUE_LENGTH, std::memory_order_release);
+        dequeuePosition++;
+    }
+    header->dropped = dropped.load(std::memory_order_relaxed);
+    // the count is updated after the records, thus a reader of a running log sees complete ones
+    __atomic_store_n(&header->written, written, __ATOMIC_RELEASE);
+    return written != start;
+}
+
+/**
+ * Expand a record into text.
+ * @param record
+ * @param format of the record, every {} is replaced by the next argument
+ * @return text of the trace
+ */
+std::string BinaryLog::decode(const BinaryLogRecord &record, const char *format) {
+    std::string text;
+    size_t position = 0;
+    const size_t length = std::min<size_t>(record.length, sizeof(record.arguments));
+    for (const char *c = format; *c != '\0'; ++c) {
+        if (c[0] != '{' || c[1] != '}') {
+            text.push_back(*c);
+            continue;
+        }
+        c++;
+        if (position + 1 > length) {
+            text.append("?");
+        } else if (record.arguments[position] == 'i' && position + 9 <= length) {
+            int64_t value;
+            memcpy(&value, record.arguments + position + 1, sizeof(value));
+            text.append(std::to_string(value));
+            position += 9;
+        } else if (record.arguments[position] == 's' && position + 2 <= length) {
+            const size_t stringLength = std::min<size_t>((unsigned char) record.arguments[position + 1],
+                                                         length - position - 2);
+            text.append(record.arguments + position + 2, stringLength);
+            position += 2 + stringLength;
+        } else {
+            text.append("?");
+            position = length;
+        }
+    }
+    return text;
+}
+
+/**
+ * Get the format of a trace.
+ * @param format
+ * @return format string
+ */
+const char *BinaryLog::getFormat(TraceFormat format) {
+    return formats[(size_t) format];
+}
+
+/**
+ * Encode a string argument. It is truncated to BINARY_LOG_STRING_LENGTH and to the space left.
+ * @param record
+ * @param value
+ */
+void BinaryLog::encodeArgument(BinaryLogRecord &record, const std::string &value) {
+    encodeString(record, value.data(), value.size());
+}
+
+/**
+ * Encode a string argument. It is truncated to BINARY_LOG_STRING_LENGTH and to the space left.
+ * @param record
+ * @param value
+ */
+void BinaryLog::encodeArgument(BinaryLogRecord &record, const char *value) {
+    encodeString(record, value, strlen(value));
+}
+
+/**
+ * Encode the characters of a string argument.
+ * @param record
+ * @param value
+ * @param length of the value
+ */
+void BinaryLog::encodeString(BinaryLogRecord &record, const char *value, size_t length) {
+    if ((size_t) record.length + 2 > sizeof(record.arguments)) return;
+    length = std::min<size_t>({length, BINARY_LOG_STRING_LENGTH, sizeof(record.arguments) - record.length - 2});
+    record.arguments[record.length] = 's';
+    record.arguments[record.length + 1] = (char) length;
+    memcpy(record.arguments + record.length + 2, value, length);
+    record.length += 2 + length;
+}
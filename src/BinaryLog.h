@@ -0,0 +1,141 @@
+#ifndef BINARYLOG_H
+#define BINARYLOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#define BINARY_LOG_MAGIC "P2PLOG1"
+#define BINARY_LOG_RECORD_SIZE 128 // bytes of a record
+#define BINARY_LOG_RECORDS (1 << 18) // records in the ring of the file, 32 MiB
+#define BINARY_LOG_QUEUE_LENGTH 32768 // records waiting for the background thread, has to be a power of two
+#define BINARY_LOG_FLUSH_INTERVAL 10 // milliseconds the background thread sleeps if the queue is empty
+#define BINARY_LOG_STRING_LENGTH 64 // longer string arguments are truncated
+
+// traces of the hot paths. A new one has to be added at the end, with its format in BinaryLog.cpp
+enum class TraceFormat : uint16_t {
+    RECEIVED_MESSAGE,
+    RECEIVED_MULTICAST,
+    LATENCY_CHANGED,
+    CLOSED_CONNECTION,
+    REMOVED_CONNECTION,
+    ADDED_PEER,
+    COUNT
+};
+
+// fixed size record: the id of the format and its raw arguments.
+// An argument is 'i' with 8 bytes of an integer or 's' with a length byte and the characters
+struct BinaryLogRecord {
+    uint64_t timestamp; // nanoseconds since the epoch
+    uint16_t format;
+    uint16_t length; // used bytes of the arguments
+    char arguments[BINARY_LOG_RECORD_SIZE - 12];
+};
+
+// start of the file, followed by the ring of records
+struct BinaryLogHeader {
+    char magic[8];
+    uint32_t recordSize;
+    uint32_t formatCount;
+    uint64_t capacity; // records in the ring
+    uint64_t written; // records ever written, the oldest one is at written - capacity
+    uint64_t dropped; // records lost while the queue was full
+    char formats[4096 - 40]; // null separated formats, thus the file can be decoded without this build
+};
+
+/**
+ * Binary log of traces. Producers on every thread encode a record and queue it without formatting,
+ * a background thread copies the records into a memory-mapped ring file. The tool logDecoder expands them.
+ */
+class BinaryLog {
+public:
+    explicit BinaryLog(const std::string &path);
+    ~BinaryLog();
+    BinaryLog(const BinaryLog &) = delete;
+    BinaryLog &operator=(const BinaryLog &) = delete;
+
+    // methods
+    void push(const BinaryLogRecord &record);
+
+    // getter
+    bool isOpen() const { return header != nullptr; }
+
+    //statics
+    template<typename... Args>
+    static void encode(BinaryLogRecord &record, TraceFormat format, const Args &... args);
+    static std::string decode(const BinaryLogRecord &record, const char *format);
+    static const char *getFormat(TraceFormat format);
+
+private:
+    // slot of the queue, the same scheme as the queue of the Logger
+    struct Slot {
+        std::atomic<size_t> sequence;
+        BinaryLogRecord record;
+    };
+
+    // fields
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<size_t> enqueuePosition{0};
+    char padding[64];
+    size_t dequeuePosition = 0; // only used by the background thread
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> running{true};
+    BinaryLogHeader *header = nullptr;
+    BinaryLogRecord *records = nullptr;
+    size_t mappedSize = 0;
+    std::thread thread;
+
+    // methods
+    void run();
+    bool flush();
+
+    //statics
+    static void encodeArguments(BinaryLogRecord &) {}
+    template<typename First, typename... Rest>
+    static void encodeArguments(BinaryLogRecord &record, const First &first, const Rest &... rest);
+    static void encodeArgument(BinaryLogRecord &record, const std::string &value);
+    static void encodeArgument(BinaryLogRecord &record, const char *value);
+    static void encodeString(BinaryLogRecord &record, const char *value, size_t length);
+    template<typename Integer, typename = typename std::enable_if<
+            std::is_integral<Integer>::value || std::is_enum<Integer>::value>::type>
+    static void encodeArgument(BinaryLogRecord &record, Integer value);
+};
+
+/**
+ * Encode a trace into a record.
+ * @param record output
+ * @param format of the trace, every {} is replaced by an argument
+ * @param args strings and integers, there is no formatting
+ */
+template<typename... Args>
+void BinaryLog::encode(BinaryLogRecord &record, TraceFormat format, const Args &... args) {
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    record.timestamp = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    record.format = (uint16_t) format;
+    record.length = 0;
+    encodeArguments(record, args...);
+}
+
+template<typename First, typename... Rest>
+void BinaryLog::encodeArguments(BinaryLogRecord &record, const First &first, const Rest &... rest) {
+    encodeArgument(record, first);
+    encodeArguments(record, rest...);
+}
+
+template<typename Integer, typename>
+void BinaryLog::encodeArgument(BinaryLogRecord &record, Integer value) {
+    // arguments that do not fit are left out
+    if ((size_t) record.length + 9 > sizeof(record.arguments)) return;
+    const auto raw = (int64_t) value;
+    record.arguments[record.length] = 'i';
+    memcpy(record.arguments + record.length + 1, &raw, sizeof(raw));
+    record.length += 9;
+}
+
+#endif
@@ -1,23 +1,38 @@
 #include <iostream>
-#include <regex>
 #include <string>
 #include <chrono>
+#include <cmath>
 #include <unistd.h>
 #include "Client.h"
 #include "Helper.h"
+#include "CommandParser.h"
+#include "Metrics.h"
 
 #pragma region Constructor
 
-Client::Client(bool debug, uint16_t multicastPort, uint16_t peerPort, const std::string &nickname) :
+Client::Client(bool debug, uint16_t multicastPort, uint16_t peerPort, const std::string &nickname,
+               const std::string &keyFile, KeyType keyType, const std::string &statsFile) :
         nickname(nickname),
-        network(NetworkManager(multicastPort, peerPort)),
+        network(multicastPort, peerPort, keyFile, keyType),
         logger(Logger::getInstance()),
-        topology(Topology(network.getHostname())) {
+        topology(Topology(network.getHostname())),
+        statsFile(statsFile) {
     logger.log("Welcome to P2P Chat!");
     // set debug mode
     logger.setDebug(debug);
     // Add self to the IpManager
     ips.add(network.getHostname(), network.getIp());
+
+    Metrics &metrics = Metrics::getInstance();
+    metrics.gauge("p2p_log_queue_depth", "Log messages waiting for output",
+                  [this]() { return (double) logger.getQueueDepth(); }, this);
+    metrics.gauge("p2p_neighbors", "Connected neighbors",
+                  [this]() { return (double) network.getNeighbors().size(); }, this);
+}
+
+Client::~Client() {
+    // the gauges read this object
+    Metrics::getInstance().removeGauges(this);
 }
 
 #pragma endregion
@@ -53,55 +68,86 @@ void Client::start() {
     json j;
     // Infinite loop processing the user input and receiving messages from the sockets
     while (true) {
-        processInput();
-        if ((j = network.processMulticastSocket()) != nullptr) processMulticastMessage(j);
-        if ((j = network.processPeerSockets()) != nullptr) processPeerMessage(j);
+        // sleep until something happens or the next link probe or stats file is due
+        auto nextTimer = nextLinkProbe;
+        if (!statsFile.empty()) nextTimer = std::min(nextTimer, nextStatsWrite);
+        if (!probes.targets.empty()) nextTimer = std::min(nextTimer, probes.next);
+        // a streaming bandwidth test only pauses to process the sockets
+        if (bandwidthTest.streaming) nextTimer = std::chrono::steady_clock::now();
+        else if (!bandwidthTest.target.empty()) nextTimer = std::min(nextTimer, bandwidthTest.end);
+        const auto untilTimer = std::chrono::duration_cast<std::chrono::milliseconds>(
+                nextTimer - std::chrono::steady_clock::now()).count();
+        if (network.waitForEvents(inputCommandQueue.getFd(), (int) std::max<long>(untilTimer, 0))) {
+            processInput();
+        }
+        if ((j = network.processMulticastSocket(0)) != nullptr) processMulticastMessage(j);
+        if ((j = network.processPeerSockets(0)) != nullptr) processPeerMessage(j);
+        maintainLinks();
+        maintainProbes();
+        maintainBandwidthTest();
+        maintainBandwidthReceivers();
+        writeStats();
+    }
+}
+
+/**
+ * Write the metrics to the Prometheus text file every METRICS_INTERVAL seconds, if one was passed.
+ */
+void Client::writeStats() {
+    if (statsFile.empty()) return;
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextStatsWrite) return;
+    nextStatsWrite = now + std::chrono::seconds(METRICS_INTERVAL);
+
+    if (!Metrics::getInstance().writePrometheus(statsFile)) {
+        logger.log("Failed to write the stats file '" + statsFile + "'.", LogType::ERROR);
+    }
+}
+
+/**
+ * Measure the latency to the neighbors every LINK_PROBE_INTERVAL seconds.
+ */
+void Client::maintainLinks() {
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextLinkProbe) return;
+    nextLinkProbe = now + std::chrono::seconds(LINK_PROBE_INTERVAL);
+
+    const auto &neighbors = network.getNeighbors();
+    // forget the latency of disconnected neighbors
+    for (auto it = linkLatencies.begin(); it != linkLatencies.end();) {
+        if (neighbors.find(it->first) == neighbors.end()) it = linkLatencies.erase(it);
+        else ++it;
+    }
+    for (auto it = linkReplyTimes.begin(); it != linkReplyTimes.end();) {
+        if (neighbors.find(it->first) == neighbors.end()) it = linkReplyTimes.erase(it);
+        else ++it;
     }
+    if (neighbors.empty()) return;
+
+    network.sendCommand(Type::LINKPROBE, {{"start", nowMicroseconds()}}, neighbors);
 }
 
 /**
  * Process all queued commands
  */
 void Client::processInput() {
-    while (!inputCommandQueue.empty()) {
-        std::string command = inputCommandQueue.front();
-        // remove the processed command
-        inputCommandQueue.pop();
-
+    std::string command, target, text;
+    Type type;
+    CommandOptions options;
+    // commands pushed after the reset signal the queue again
+    inputCommandQueue.clearSignal();
+    while (inputCommandQueue.pop(command)) {
         // remove leading and trailing spaces
         trim(command);
 
         if (command.empty()) continue;
 
         // Command type is case insensitive
-        std::regex commandRegex;
-        commandRegex.assign(
-                R"(^/(quit|list|neighbors|plot|getkeypair|((leave|nick|gettopic|getmembers|getpublickey)\s+[\w\d]+)|((settopic|msg)\s+[\w\d]+\s+.+)|((route|help)\s*[\w\d]*)|(ping\s+[\w\d\:]+)|(join\s+[\w\d]+\s+[\w\d]+))$)",
-                std::regex::icase);
-
-        if (!regex_match(command, commandRegex)) {
+        if (!CommandParser::parse(command, type, target, text, options)) {
             logger.log("Invalid command entered. Try again.", LogType::ERROR);
             continue;
         }
-
-        // parse
-        std::string typeString, target, text;
-        int pos = command.find(' ');
-        // start at 1 to ignore the '/'
-        typeString = rtrim_copy(command.substr(1, pos));
-        if (pos != -1) { // check if second string was passed
-            command.erase(0, pos + 1);
-            ltrim(command);
-            pos = command.find(' ');
-            target = rtrim_copy(command.substr(0, pos));
-            if (pos != -1) // check if a third string was passed
-            {
-                command.erase(0, pos + 1);
-                ltrim(command);
-                text = command;
-            }
-        }
-        processCommand(convertToType(typeString), target, text);
+        processCommand(type, target, text, options);
     }
 }
 
@@ -111,7 +157,7 @@ void Client::processInput() {
  * @param target
  * @param text
  */
-void Client::processCommand(Type type, std::string &target, const std::string &text) {
+void Client::processCommand(Type type, std::string &target, const std::string &text, const CommandOptions &options) {
     json payload;
     std::set<std::string> nextHops;
     switch (type) {
@@ -150,6 +196,15 @@ void Client::processCommand(Type type, std::string &target, const std::string &t
             handleInputCommandHelp();
             return;
         }
+        case Type::STATS:
+            logger.log("Statistics:" + Metrics::getInstance().toText());
+            return;
+        case Type::TRACEROUTE:
+            handleInputCommandTraceroute(target, options);
+            return;
+        case Type::BWTEST:
+            handleInputCommandBandwidthTest(target, text);
+            return;
         case Type::QUIT:
             handleInputCommandQuit();
             return;
@@ -164,8 +219,14 @@ void Client::processCommand(Type type, std::string &target, const std::string &t
                     return;
                 }
                 if ((nextHops = getNextHops(target, false, true)).empty()) return;
-                // encrypt the message with the group key
-                payload["text"] = network.groupEncrypt(text, target);
+                // the cached sessions of X25519 seal a hop faster than a signature of a frame is checked
+                if (network.getKeyType() == KeyType::X25519) {
+                    payload["text"] = network.groupEncrypt(text, target);
+                    break;
+                }
+                // encrypted once with the group key, all next hops get the same signed frame
+                network.sendGroupMessage(target, text, nextHops, options.trace);
+                return;
             } else {
                 std::string hostname = nicknames.reverseLookup(target);
                 if (hostname.empty()) {
@@ -197,6 +258,20 @@ void Client::processCommand(Type type, std::string &target, const std::string &t
                 logger.log("You cannot ping yourself.", LogType::WARN);
                 return;
             }
+            // the interval only applies to a series, which is not traced
+            if (options.count == 0 && options.interval > 0) {
+                logger.log("The interval of pings needs a count, e.g. /ping -c 10 -i 0.2 NAME.", LogType::WARN);
+                return;
+            }
+            if (options.count > 0 && options.trace) {
+                logger.log("A series of pings cannot be traced, use a single /ping -t.", LogType::WARN);
+                return;
+            }
+            // a series of pings is sent by the main loop
+            if (options.count > 0) {
+                startProbes({hostname}, options, false);
+                return;
+            }
             if ((nextHops = getNextHops(hostname, true, false)).empty()) return;
             // replace passed nickname with hostname
             target = hostname;
@@ -270,7 +345,8 @@ void Client::processCommand(Type type, std::string &target, const std::string &t
     }
 
     payload["target"] = target;
-    json message = network.sendCommand(type, payload, nextHops);
+    // traced messages start with an empty array of hops
+    json message = network.sendCommand(type, payload, nextHops, options.trace ? json::array() : json());
     if (message != nullptr) {
         messages.addProposal(message);
         // directly execute proposals if only one peer connected
@@ -282,21 +358,31 @@ void Client::processCommand(Type type, std::string &target, const std::string &t
 
 /**
  * Get the next hops needed to reach the recipients.
+ * Messages to a host are spread over its loop free paths by their flow of origin and recipient.
  * @param recipient hostname or groupname
  * @param checkHostname true: recipient can be a hostname
  * @param checkGroupname true: recipient can be a groupname
+ * @param origin hostname of the origin of the message, default is this client
+ * @param receivedFrom hostname of the peer the message came from, it is not used as next hop
  * @return set of next hops for a host or all members of a group
  */
-std::set<std::string> Client::getNextHops(const std::string &recipient, bool checkHostname, bool checkGroupname) {
+std::set<std::string> Client::getNextHops(const std::string &recipient, bool checkHostname, bool checkGroupname,
+                                          const std::string &origin, const std::string &receivedFrom) {
     std::set<std::string> nextHops;
     Group *group;
 
     if (checkGroupname && (group = groups.get(recipient)) != nullptr) {
-        for (const auto &member : group->getMembers()) {
-            nextHops.insert(topology.getPeer(member)->nextHop);
-        }
+        // group messages are forwarded along the distribution tree, which is only recalculated on changes
+        if (group->isTreeOutdated(topology.getVersion()))
+            group->setTreeNeighbors(topology.calculateTreeNeighbors(group->getMembers()), topology.getVersion());
+        nextHops = group->getTreeNeighbors();
+        nextHops.erase(receivedFrom);
     } else if (checkHostname && !nicknames.get(recipient).empty()) {
-        nextHops.insert(topology.getPeer(recipient)->nextHop);
+        auto availableHops = network.getNeighbors();
+        availableHops.erase(receivedFrom);
+        auto flow = (origin.empty() ? network.getHostname() : origin) + '>' + recipient;
+        auto nextHop = topology.getNextHop(recipient, flow, availableHops);
+        if (!nextHop.empty()) nextHops.insert(nextHop);
     }
 
     // erase this client from next hops
@@ -305,29 +391,71 @@ std::set<std::string> Client::getNextHops(const std::string &recipient, bool che
     return nextHops;
 }
 
+/**
+ * Get the next hop of a route that a message follows instead of the routing of every hop.
+ * @param route hostnames from the origin to the recipient
+ * @return set with the hostname after this peer, empty if this peer is not on the route or the next hop is
+ * not connected
+ */
+std::set<std::string> Client::getRouteHops(const json &route) {
+    std::set<std::string> nextHops;
+    if (!route.is_array()) return nextHops;
+    for (size_t i = 0; i + 1 < route.size(); ++i) {
+        if (route[i] != network.getHostname()) continue;
+        if (route[i + 1].is_string() && network.getNeighbors().count((std::string) route[i + 1])) {
+            nextHops.insert((std::string) route[i + 1]);
+        }
+        break;
+    }
+    return nextHops;
+}
+
+/**
+ * Forward a message to a host. If sending to the next hop fails, the message is sent over the next
+ * alternative right away, without waiting for the failed peer to be removed.
+ * @param message
+ * @param hostname of the target
+ * @param receivedFrom hostname of the peer the message came from
+ */
+void Client::forwardToPeer(const json &message, const std::string &hostname, const std::string &receivedFrom) {
+    std::set<std::string> nextHops;
+    // failed next hops are no longer neighbors, thus every try takes another one
+    while (!(nextHops = getNextHops(hostname, true, false, (std::string) message["origin"], receivedFrom)).empty()) {
+        if (network.forwardMessage(message, nextHops).empty()) return;
+    }
+}
+
 /**
  * Process the json received from the multicast socket.
  */
 void Client::processMulticastMessage(json &message) {
-    auto bridgePeers = topology.calculateBridgePeer();
     std::string ip = message["ip"];
-    logger.log("Received multicast message from '" + ip + "'.", LogType::DEBUG);
+    auto bridge = topology.calculateBridgePeer(ip);
+    const auto &bridgePeers = bridge.peers;
+    logger.trace(TraceFormat::RECEIVED_MULTICAST, ip);
     if (std::find(bridgePeers.begin(), bridgePeers.end(), network.getHostname()) == bridgePeers.end()) {
         logger.log("Other peers have to connect to the new peer.", LogType::DEBUG);
         return;
     }
     logger.log("Connecting to new peer at '" + ip + "'.");
 
+    // connections replaced by the new peer are closed after it announced its connections
+    for (const auto &connection : bridge.replacedConnections) {
+        if (connection[0] == network.getHostname()) network.expectDisconnect(connection[1]);
+        if (connection[1] == network.getHostname()) network.expectDisconnect(connection[0]);
+    }
+
     auto hostname = network.connectToPeer(ip, std::to_string((int) message["port"]));
 
     // the first peer should send the network data to the new peer
     if (bridgePeers.at(0) == network.getHostname() && !hostname.empty()) {
         json payload{
-                {"topology",  topology.toJson()},
-                {"ips",       ips.toJson()},
-                {"nicknames", nicknames.toJson()},
-                {"groups",    groups.toJson()},
-                {"crypto",    network.cryptoToJson()}
+                {"topology",            topology.toJson()},
+                {"ips",                 ips.toJson()},
+                {"nicknames",           nicknames.toJson()},
+                {"groups",              groups.toJson()},
+                {"crypto",              network.cryptoToJson()},
+                {"replacedConnections", bridge.replacedConnections}
         };
 
         // save the public key of the new peer, so the INIT command is encrypted
@@ -341,7 +469,32 @@ void Client::processMulticastMessage(json &message) {
  * Process the json received from a peer.
  */
 void Client::processPeerMessage(json &message) {
-    logger.log("Received message: " + message.dump(), LogType::DEBUG);
+    // the arguments are only extracted if they are traced
+    if (logger.isTracing()) {
+        logger.trace(TraceFormat::RECEIVED_MESSAGE, message.value("id", ""), message.value("type", -1),
+                     message.value("origin", ""), message.value("receivedFrom", ""));
+    }
+
+    // link local messages are never forwarded, thus they skip the check of received messages
+    switch (static_cast<Type>(message["type"])) {
+        case Type::LINKPROBE:
+            // the receive time is added by the network manager, without it the hold is unknown
+            if (!message["receivedAt"].is_number() || !message["payload"]["start"].is_number()) return;
+            handlePeerCommandLinkProbe((std::string) message["receivedFrom"], message["payload"]["start"],
+                                       message["receivedAt"]);
+            return;
+        case Type::LINKREPLY:
+            if (!message["receivedAt"].is_number() || !message["payload"]["start"].is_number() ||
+                !message["payload"]["hold"].is_number()) {
+                return;
+            }
+            handlePeerCommandLinkReply((std::string) message["receivedFrom"], message["payload"]["start"],
+                                       message["payload"]["hold"], message["receivedAt"]);
+            return;
+        default:
+            break;
+    }
+
     // check already received messages
     if (messages.checkReceivedStatus((std::string) message["id"])) return;
 
@@ -355,48 +508,70 @@ void Client::processPeerMessage(json &message) {
     switch (static_cast<Type>(message["type"])) {
         case Type::REMOVEPEER:
             // first broadcast
-            nextHops = network.getNeighbors();
-            nextHops.erase((std::string) message["receivedFrom"]); // remove the hop the message came from
-            network.forwardMessage(message, nextHops);
+            network.broadcastMessage(message, (std::string) message["receivedFrom"]);
 
             handlePeerCommandRemovePeer((std::string) message["payload"]);
             break;
         case Type::ADDCONNECTION:
             handlePeerCommandAddConnection(message["payload"]);
             // broadcast this message
-            nextHops = network.getNeighbors();
-            nextHops.erase((std::string) message["receivedFrom"]); // remove the hop the message came from
-            network.forwardMessage(message, nextHops);
+            network.broadcastMessage(message, (std::string) message["receivedFrom"]);
             break;
         case Type::SETTOPIC:
             handlePeerCommandSetTopic((std::string) message["origin"], (std::string) message["payload"]["target"],
                                       (std::string) message["payload"]["text"]);
             // broadcast this message
-            nextHops = network.getNeighbors();
-            nextHops.erase((std::string) message["receivedFrom"]); // remove the hop the message came from
-            network.forwardMessage(message, nextHops);
+            network.broadcastMessage(message, (std::string) message["receivedFrom"]);
             break;
         case Type::MSG:
             // check if this peer is member of the group or recipient of this message
             if (isRecipient(network.getHostname(), (std::string) message["payload"]["target"])) {
                 handlePeerCommandMsg((std::string) message["origin"], (std::string) message["payload"]["target"],
                                      (std::string) message["payload"]["text"]);
+                if (message.contains("hops")) logHops((std::string) message["origin"], message["hops"]);
                 // do not forward, if this client is the recipient
                 if ((std::string) message["payload"]["target"] == network.getHostname()) break;
             }
             // forward message
-            nextHops = getNextHops((std::string) message["payload"]["target"], true, true);
-            nextHops.erase((std::string) message["receivedFrom"]); // remove the hop the message came from
+            if (groups.get((std::string) message["payload"]["target"]) == nullptr) {
+                forwardToPeer(message, (std::string) message["payload"]["target"],
+                              (std::string) message["receivedFrom"]);
+                break;
+            }
+            // the tree neighbors except the hop the message came from
+            nextHops = getNextHops((std::string) message["payload"]["target"], false, true, "",
+                                   (std::string) message["receivedFrom"]);
             network.forwardMessage(message, nextHops);
             break;
+        case Type::LINKSTATE:
+            handlePeerCommandLinkState((std::string) message["origin"], message["payload"]["weights"]);
+            // broadcast this message
+            network.broadcastMessage(message, (std::string) message["receivedFrom"]);
+            break;
         case Type::PING:
         case Type::PONG:
             if (network.getHostname() == (std::string) message["payload"]["target"])
                 handlePeerCommandPing((std::string) message["origin"], static_cast<Type>(message["type"]),
-                                      message["payload"]["start"]);
-            else {
-                nextHops = getNextHops((std::string) message["payload"]["target"], true, false);
-                network.forwardMessage(message, nextHops);
+                                      message["payload"], message.value("hops", json()));
+            else if (message["payload"].contains("route")) {
+                // probes of a traceroute follow the measured path, a broken one loses them
+                nextHops = getRouteHops(message["payload"]["route"]);
+                if (!nextHops.empty()) network.forwardMessage(message, nextHops);
+            } else {
+                forwardToPeer(message, (std::string) message["payload"]["target"],
+                              (std::string) message["receivedFrom"]);
+            }
+            break;
+        case Type::BWTEST:
+        case Type::BWREPORT:
+            if (network.getHostname() != (std::string) message["payload"]["target"]) {
+                forwardToPeer(message, (std::string) message["payload"]["target"],
+                              (std::string) message["receivedFrom"]);
+            } else if (static_cast<Type>(message["type"]) == Type::BWTEST) {
+                handlePeerCommandBandwidthTest((std::string) message["origin"], message["payload"],
+                                               message.value("hops", json()));
+            } else {
+                handlePeerCommandBandwidthReport((std::string) message["origin"], message["payload"]);
             }
             break;
         default:
@@ -416,11 +591,8 @@ void Client::processProposal(json &message) {
     if (((std::string) message["origin"]) == network.getHostname()) return;
 
     Type messageType = static_cast<Type>(message["type"]);
-    // next hops for broadcast
-    auto nextHops = network.getNeighbors();
-    nextHops.erase((std::string) message["receivedFrom"]); // remove the hop the message came from
     // forward the proposal to everyone
-    network.forwardMessage(message, nextHops);
+    network.broadcastMessage(message, (std::string) message["receivedFrom"]);
 
     bool confirm = true;
     // check if join is valid
@@ -487,8 +659,10 @@ void Client::processProposal(json &message) {
         }
     }
 
-    logger.log("Sending " + std::string(confirm ? "Confirmation" : "Reject") + " for proposal " +
-               (std::string) message["id"], LogType::DEBUG);
+    logger.log([&]() {
+        return "Sending " + std::string(confirm ? "Confirmation" : "Reject") + " for proposal " +
+               (std::string) message["id"];
+    }, LogType::DEBUG);
     network.sendCommand(confirm ? Type::CONFIRMATION : Type::REJECT, (std::string) message["id"],
                         network.getNeighbors());
 }
@@ -500,7 +674,7 @@ void Client::processProposal(json &message) {
 void Client::executeProposal(const std::string &id) {
     auto json = messages.getProposal(id);
     // remove executed proposal
-    messages.removeProposal(id);
+    messages.removeProposal(id, true);
 
     switch (static_cast<Type>(json["type"])) {
         case Type::JOIN:
@@ -559,10 +733,16 @@ void Client::receiveNetworkData() {
         // load crypto
         network.cryptoLoadJson(j["payload"]["crypto"]);
 
+        // remove the connections this peer replaces
+        json removedConnections = j["payload"].value("replacedConnections", json::array());
+        for (const auto &item : removedConnections.items()) {
+            topology.setConnection((std::string) item.value()[0], (std::string) item.value()[1], false);
+        }
+
         json connections;
 
         // add new links to neighbors of this peer
-        auto neighbors = network.getNeighbors();
+        const auto &neighbors = network.getNeighbors();
         for (auto const &neighbor: neighbors) {
             topology.setConnection(network.getHostname(), neighbor, true);
             connections.push_back({network.getHostname(), neighbor}); // create json with new connections
@@ -577,8 +757,9 @@ void Client::receiveNetworkData() {
 
         // Broadcast new connection between this and the neighbors to the network
         network.sendCommand(Type::ADDCONNECTION, {
-                {"connections", connections},
-                {"newPeers",    {{
+                {"connections",        connections},
+                {"removedConnections", removedConnections},
+                {"newPeers",           {{
                                          network.getHostname(), {
                                                                         {"ip", network.getIp()},
                                                                         {"name", nickname},
@@ -592,6 +773,31 @@ void Client::receiveNetworkData() {
     }
 }
 
+/**
+ * Handles the reconnect between the former neighbors of a peer that left the network.
+ * Every peer applies the same new connections to its topology, but only the first peer of each pair connects.
+ * @param formerNeighbors neighbors of the peer that left
+ */
+void Client::handleNetworkLeave(const std::set<std::string> &formerNeighbors) {
+    auto repairConnections = topology.calculateLeaveRepair(formerNeighbors);
+    bool waitForConnection = false;
+    for (const auto &connection : repairConnections) {
+        topology.setConnection(connection[0], connection[1], true);
+        if (connection[0] == network.getHostname()) {
+            logger.log("Replacing the lost connection with a connection to Peer ('" +
+                       nicknames.get(connection[1]) + "').");
+            network.connectToPeer(ips.get(connection[1]));
+        } else if (connection[1] == network.getHostname()) {
+            waitForConnection = true;
+        }
+    }
+
+    if (waitForConnection) {
+        logger.log("Waiting for another peer to replace the lost connection.");
+        network.acceptPeerConnection(3);
+    }
+}
+
 /**
  * Handles the reconnect in case a disconnect of a peer causes a network fracture. Some peers do an active
  * reconnect and other just wait for peer connections.
@@ -657,6 +863,7 @@ void Client::handlePeerCommandRemovePeer(const std::string &payload) {
     // remove message id
     messages.removeMessageId(payload);
     // remove from groups, topology, nicknames, ips
+    auto formerNeighbors = topology.getNeighbors(payload);
     topology.removePeer(payload);
 
     auto leftGroups = groups.removeFromAllGroups(payload);
@@ -673,8 +880,10 @@ void Client::handlePeerCommandRemovePeer(const std::string &payload) {
 
     nicknames.remove(payload);
     ips.remove(payload);
+    network.removePublicKey(payload);
 
     // check if the network needs reconnects
+    handleNetworkLeave(formerNeighbors);
     if (topology.isFractured()) handleNetworkFracture();
     else if (topology.isUnderconnected()) handleNetworkUnderconnected();
 }
@@ -692,7 +901,7 @@ void Client::handlePeerCommandAddConnection(const json &payload) {
             nicknames.add(currentHostname, (std::string) item.value()["name"]);
             ips.add(currentHostname, (std::string) item.value()["ip"]);
             network.addPublicKey(currentHostname, (std::string) item.value()["publicKey"]);
-            logger.log("Added new peer (Hostname: '" + currentHostname + "').", LogType::DEBUG);
+            logger.trace(TraceFormat::ADDED_PEER, currentHostname);
             logger.log("Peer ('" + nicknames.get(currentHostname) + "') joined the chat.");
         }
     }
@@ -700,8 +909,21 @@ void Client::handlePeerCommandAddConnection(const json &payload) {
         json connections = payload["connections"];
         for (const auto &item : connections.items()) {
             topology.setConnection((std::string) item.value()[0], (std::string) item.value()[1], true);
-            logger.log("Added new connection between '" + (std::string) item.value()[0] + "' and '" +
-                       (std::string) item.value()[1] + "'.", LogType::DEBUG);
+            logger.log([&]() {
+                return "Added new connection between '" + (std::string) item.value()[0] + "' and '" +
+                       (std::string) item.value()[1] + "'.";
+            }, LogType::DEBUG);
+        }
+    }
+    if (payload.contains("removedConnections")) {
+        json removedConnections = payload["removedConnections"];
+        for (const auto &item : removedConnections.items()) {
+            std::string hostname1 = item.value()[0], hostname2 = item.value()[1];
+            topology.setConnection(hostname1, hostname2, false);
+            // close the connection if this peer is part of it
+            if (hostname1 == network.getHostname()) network.disconnectFromPeer(hostname2);
+            if (hostname2 == network.getHostname()) network.disconnectFromPeer(hostname1);
+            logger.trace(TraceFormat::REMOVED_CONNECTION, hostname1, hostname2);
         }
     }
 }
@@ -717,8 +939,9 @@ void Client::handlePeerCommandJoin(const std::string &hostname, const std::strin
         group->addMember(hostname);
         logger.log("Peer ('" + nicknames.get(hostname) + "') joined group '" + groupname + "'.");
     } else
-        logger.log("Peer ('" + nicknames.get(hostname) + "') can't join unknown group '" + groupname + "'.",
-                   LogType::DEBUG);
+        logger.log([&]() {
+            return "Peer ('" + nicknames.get(hostname) + "') can't join unknown group '" + groupname + "'.";
+        }, LogType::DEBUG);
 }
 
 /**
@@ -730,8 +953,9 @@ void Client::handlePeerCommandCreate(const std::string &hostname, const std::str
     if (groups.create(groupname, hostname) != nullptr)
         logger.log("Peer ('" + nicknames.get(hostname) + "') created group '" + groupname + "'.");
     else
-        logger.log("Peer ('" + nicknames.get(hostname) + "') failed creating group '" + groupname + "'.",
-                   LogType::DEBUG);
+        logger.log([&]() {
+            return "Peer ('" + nicknames.get(hostname) + "') failed creating group '" + groupname + "'.";
+        }, LogType::DEBUG);
 }
 
 /**
@@ -751,8 +975,9 @@ void Client::handlePeerCommandLeave(const std::string &hostname, const std::stri
             logger.log("Last member ('" + nicknames.get(hostname) + "') left group '" + groupName +
                        "'. Removing the group.");
     } else
-        logger.log("Peer ('" + nicknames.get(hostname) + "') can not leave unknown group '" + groupname + "'.",
-                   LogType::DEBUG);
+        logger.log([&]() {
+            return "Peer ('" + nicknames.get(hostname) + "') can not leave unknown group '" + groupname + "'.";
+        }, LogType::DEBUG);
 }
 
 /**
@@ -765,7 +990,7 @@ void Client::handlePeerCommandNick(const std::string &hostname, const std::strin
     if (nicknames.rename(hostname, nick))
         logger.log("Peer ('" + oldNick + "') changed nick to '" + nick + "'.");
     else
-        logger.log("Failed to change nick of Peer ('" + oldNick + "').", LogType::DEBUG);
+        logger.log([&]() { return "Failed to change nick of Peer ('" + oldNick + "')."; }, LogType::DEBUG);
 }
 
 /**
@@ -778,14 +1003,16 @@ void
 Client::handlePeerCommandSetTopic(const std::string &hostname, const std::string &groupname, const std::string &text) {
     auto group = groups.get(groupname);
     if (group == nullptr) {
-        logger.log("Peer ('" + nicknames.get(hostname) + "') tried to set topic of unknown group '" + groupname + "'.",
-                   LogType::DEBUG);
+        logger.log([&]() {
+            return "Peer ('" + nicknames.get(hostname) + "') tried to set topic of unknown group '" + groupname + "'.";
+        }, LogType::DEBUG);
         return;
     }
     if (group->getAdmin() != hostname) {
-        logger.log(
-                "Peer ('" + nicknames.get(hostname) + "') tried to set topic of group '" + groupname +
-                "', but is not admin.", LogType::DEBUG);
+        logger.log([&]() {
+            return "Peer ('" + nicknames.get(hostname) + "') tried to set topic of group '" + groupname +
+                   "', but is not admin.";
+        }, LogType::DEBUG);
         return;
     }
     logger.log("Peer ('" + nicknames.get(hostname) + "') set topic of group '" + groupname + "' to '" + text + "'.");
@@ -811,19 +1038,283 @@ void Client::handlePeerCommandMsg(const std::string &hostname, const std::string
  * Handle ping and pong if this peer is the target of the command.
  * @param origin of the ping or pong
  * @param type Ping or Pong
- * @param timestamp PING: timestamp from the message. PONG: timestamp from ping message
+ * @param payload PING: with the timestamp of the origin. PONG: with the timestamp copied from the ping
+ * @param hops records of a traced ping or pong, otherwise nullptr
  */
-void Client::handlePeerCommandPing(const std::string &origin, Type type, long timestamp) {
+void Client::handlePeerCommandPing(const std::string &origin, Type type, const json &payload, const json &hops) {
     if (type == Type::PING) {
-        // send PONG to origin and copy original ping timestamp
-        network.sendCommand(Type::PONG, {
+        // send PONG to origin and copy original ping timestamp. The hops of a traced ping are continued
+        json pong = {
                 {"target", origin},
-                {"start",  timestamp}
-        }, getNextHops(origin, true, false));
+                {"start",  payload["start"]}
+        };
+        // pings of a series are matched by their number
+        if (payload.contains("series")) {
+            pong["series"] = payload["series"];
+            pong["sequence"] = payload["sequence"];
+        }
+        // the pong of a traceroute returns along the reversed route of its ping
+        if (payload.contains("route") && payload["route"].is_array()) {
+            json route = payload["route"];
+            std::reverse(route.begin(), route.end());
+            pong["route"] = route;
+            network.sendCommand(Type::PONG, pong, getRouteHops(route), hops);
+            return;
+        }
+        network.sendCommand(Type::PONG, pong, getNextHops(origin, true, false), hops);
+    } else if (payload.contains("series")) {
+        handleProbeReply(origin, payload);
     } else {
         long now = std::chrono::duration_cast<std::chrono::milliseconds>(
                 std::chrono::steady_clock::now().time_since_epoch()).count();
-        logger.log("Ping to Peer ('" + nicknames.get(origin) + "') is " + std::to_string(now - timestamp) + "ms.");
+        logger.log("Ping to Peer ('" + nicknames.get(origin) + "') is " + std::to_string(now - (long) payload["start"]) +
+                   "ms.");
+        if (hops.is_array()) logHops(network.getHostname(), hops);
+    }
+}
+
+/**
+ * Start a series of pings, which replaces a running one. Every round pings all targets once.
+ * @param targets hostnames
+ * @param options count and interval of the rounds
+ * @param traceroute true: the targets are the hops of a path
+ */
+void Client::startProbes(const std::vector<std::string> &targets, const CommandOptions &options, bool traceroute) {
+    if (!probes.targets.empty()) logProbeStatistics();
+
+    probes.id++;
+    probes.traceroute = traceroute;
+    probes.targets = targets;
+    probes.count = options.count > 0 ? options.count : TRACEROUTE_PROBES;
+    probes.sent = 0;
+    const double interval = options.interval > 0 ? options.interval : PROBE_INTERVAL;
+    probes.interval = std::chrono::microseconds((long) (interval * 1e6));
+    probes.rtts.assign(targets.size(), {});
+    probes.sequences.assign(targets.size(), {});
+    probes.next = std::chrono::steady_clock::now();
+    maintainProbes();
+}
+
+/**
+ * Send the next round of a ping series when it is due. The statistics are printed after the timeout of the last one.
+ */
+void Client::maintainProbes() {
+    if (probes.targets.empty()) return;
+    auto now = std::chrono::steady_clock::now();
+    if (now < probes.next) return;
+
+    if (probes.sent == probes.count) {
+        logProbeStatistics();
+        return;
+    }
+
+    json route = json::array({network.getHostname()});
+    for (const auto &target : probes.targets) {
+        json ping = {
+                {"target",   target},
+                {"start",    nowMicroseconds()},
+                {"series",   probes.id},
+                {"sequence", probes.sent}
+        };
+        std::set<std::string> nextHops;
+        if (probes.traceroute) {
+            // the probes follow the printed path, the routing of the hops could take another one
+            route.push_back(target);
+            ping["route"] = route;
+            nextHops = getRouteHops(route);
+        } else {
+            nextHops = getNextHops(target, true, false);
+        }
+        if (nextHops.empty()) continue;
+        network.sendCommand(Type::PING, ping, nextHops);
+    }
+    probes.sent++;
+    probes.next = now + (probes.sent < probes.count ? probes.interval
+                                                    : std::chrono::microseconds(PROBE_TIMEOUT * 1000000L));
+}
+
+/**
+ * Add the rtt of a pong to the running ping series. The series ends early if all pongs arrived.
+ * @param origin hostname of the pinged peer
+ * @param payload of the pong
+ */
+void Client::handleProbeReply(const std::string &origin, const json &payload) {
+    if (probes.targets.empty() || payload["series"] != probes.id || !payload["start"].is_number() ||
+        !payload["sequence"].is_number_integer()) {
+        return;
+    }
+    auto target = std::find(probes.targets.begin(), probes.targets.end(), origin);
+    if (target == probes.targets.end()) return;
+    // every probe is counted once, thus the loss stays between 0 and 100%
+    const int sequence = payload["sequence"];
+    if (sequence < 0 || sequence >= probes.sent ||
+        !probes.sequences[target - probes.targets.begin()].insert(sequence).second) {
+        return;
+    }
+
+    const double rtt = (nowMicroseconds() - (long) payload["start"]) / 1000.0;
+    auto &rtts = probes.rtts[target - probes.targets.begin()];
+    rtts.push_back(rtt);
+    if (!probes.traceroute) {
+        logger.log("Reply from '" + nicknames.get(origin) + "': sequence=" + payload["sequence"].dump() + " time=" +
+                   std::to_string(rtt) + "ms");
+    }
+
+    size_t received = 0;
+    for (const auto &targetRtts : probes.rtts) received += targetRtts.size();
+    if (probes.sent == probes.count && received == probes.targets.size() * probes.count) logProbeStatistics();
+}
+
+/**
+ * Print min, avg, p50, p99 and max of the rtts and the loss per target and end the ping series.
+ * A traceroute also prints the difference of the median to the former hop, which is the latency of the link.
+ */
+void Client::logProbeStatistics() {
+    auto format = [](double milliseconds) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.3f", milliseconds);
+        return std::string(buffer);
+    };
+
+    std::string statistics = probes.traceroute ? "Traceroute to '" + nicknames.get(probes.targets.back()) +
+                                                 "' (rtt min/avg/p50/p99/max in ms):"
+                                               : "Ping statistics for '" + nicknames.get(probes.targets.front()) +
+                                                 "' (rtt min/avg/p50/p99/max in ms):";
+    double formerMedian = 0;
+    for (size_t i = 0; i < probes.targets.size(); ++i) {
+        auto &rtts = probes.rtts[i];
+        const int loss = probes.sent == 0 ? 0 : (int) std::lround(100.0 * (probes.sent - (int) rtts.size()) /
+                                                                  probes.sent);
+        statistics += "\n  ";
+        if (probes.traceroute) statistics += std::to_string(i + 1) + ' ' + nicknames.get(probes.targets[i]) + ": ";
+        statistics += std::to_string(probes.sent) + " sent, " + std::to_string(rtts.size()) + " received, " +
+                      std::to_string(loss) + "% loss";
+        if (rtts.empty()) continue;
+
+        // nearest rank percentiles of the few measurements
+        std::sort(rtts.begin(), rtts.end());
+        auto percentile = [&rtts](double q) {
+            return rtts[(size_t) std::max(std::ceil(q * rtts.size()) - 1, 0.0)];
+        };
+        double sum = 0;
+        for (const auto rtt : rtts) sum += rtt;
+        statistics += ", " + format(rtts.front()) + '/' + format(sum / rtts.size()) + '/' + format(percentile(0.5)) +
+                      '/' + format(percentile(0.99)) + '/' + format(rtts.back());
+        if (probes.traceroute) {
+            statistics += ", link +" + format(std::max(percentile(0.5) - formerMedian, 0.0));
+            formerMedian = percentile(0.5);
+        }
+    }
+    logger.log(statistics);
+    probes.targets.clear();
+}
+
+/**
+ * Print the latency breakdown of a traced message: the time every hop spent opening it and waiting in queues,
+ * and the links in between. Link times compare the clocks of two peers, thus they need synchronized clocks.
+ * @param origin hostname of the peer that started the trace
+ * @param hops records of the hops, the last one is this peer
+ */
+void Client::logHops(const std::string &origin, const json &hops) {
+    const long now = wallMicroseconds();
+    auto name = [this](const std::string &hostname) {
+        const std::string nickname = nicknames.get(hostname);
+        return nickname.empty() ? hostname : nickname;
+    };
+
+    std::string breakdown;
+    long start = 0, previousSent = 0;
+    HopRecord record;
+    for (const auto &hop : hops) {
+        if (!readHop(hop, now, record)) {
+            logger.log("Received a traced message with invalid hops.", LogType::WARN);
+            return;
+        }
+        if (start == 0) start = record.received;
+        else breakdown += "\n  -> link " + std::to_string(record.received - previousSent) + "us";
+        breakdown += "\n  " + name(record.hostname) + ": crypto " + std::to_string(record.crypto) + "us, queue " +
+                     std::to_string(record.queue) + "us";
+        previousSent = record.sent;
+    }
+    if (start == 0) return;
+    logger.log("Hops of the message from '" + name(origin) + "' (" + std::to_string(now - start) + "us):" + breakdown);
+}
+
+/**
+ * Read a record of a traced message. The record of this peer is not completed, it ends now.
+ * Its queue time is measured with the steady receive time of the record.
+ * @param hop record of the message
+ * @param now wall time in microseconds
+ * @param record output
+ * @return false if the record is invalid
+ */
+bool Client::readHop(const json &hop, long now, HopRecord &record) {
+    if (!hop.is_array() || hop.size() < 4 || !hop[0].is_string() || !hop[1].is_number() || !hop[2].is_number() ||
+        !hop[3].is_number()) {
+        return false;
+    }
+    record.hostname = hop[0];
+    record.received = hop[1];
+    record.crypto = hop[2];
+    const bool completed = hop.size() >= 5 && hop[4].is_number();
+    record.queue = completed ? hop[3].get<long>() : nowMicroseconds() - hop[3].get<long>() - record.crypto;
+    record.sent = completed ? hop[4].get<long>() : now;
+    return true;
+}
+
+/**
+ * Answer a link probe of a neighbor. The time the probe was held by this peer is subtracted from the rtt
+ * by the prober. The reply is sealed after the hold is taken, thus the duration of the last reply is added.
+ * @param hostname of the neighbor
+ * @param start timestamp of the link probe in microseconds, only used by the prober
+ * @param received steady time of the receive of the probe in microseconds
+ */
+void Client::handlePeerCommandLinkProbe(const std::string &hostname, long start, long received) {
+    const long now = nowMicroseconds();
+    auto replyTime = linkReplyTimes.emplace(hostname, 0).first;
+    network.sendCommand(Type::LINKREPLY, {{"start", start}, {"hold", now - received + replyTime->second}},
+                        {hostname});
+    replyTime->second = nowMicroseconds() - now;
+}
+
+/**
+ * Update the smoothed rtt to a neighbor. Changes outside of the hysteresis are used for routing and
+ * broadcasted to the network, smaller ones are ignored to avoid route flapping.
+ * @param hostname of the neighbor
+ * @param start steady time of the link probe in microseconds
+ * @param hold time the neighbor held the probe before its reply in microseconds
+ * @param received steady time of the receive of the reply in microseconds
+ */
+void Client::handlePeerCommandLinkReply(const std::string &hostname, long start, long hold, long received) {
+    // a hold longer than the whole probe is no valid sample
+    if (received - start - hold <= 0) return;
+    double rtt = received - start - hold;
+    auto linkLatency = linkLatencies.find(hostname);
+    if (linkLatency == linkLatencies.end()) {
+        linkLatency = linkLatencies.emplace(hostname, LinkLatency{rtt, 0}).first;
+    } else {
+        linkLatency->second.smoothedRtt += LINK_RTT_SMOOTHING * (rtt - linkLatency->second.smoothedRtt);
+    }
+
+    auto &latency = linkLatency->second;
+    if (latency.weight != 0 &&
+        std::abs(latency.smoothedRtt - latency.weight) <= latency.weight * LINK_WEIGHT_HYSTERESIS)
+        return;
+
+    latency.weight = (int) latency.smoothedRtt;
+    if (!topology.setLinkWeight(network.getHostname(), hostname, latency.weight)) return;
+    logger.trace(TraceFormat::LATENCY_CHANGED, hostname, latency.weight);
+    network.sendCommand(Type::LINKSTATE, {{"weights", {{hostname, latency.weight}}}}, network.getNeighbors());
+}
+
+/**
+ * Update the latencies measured by another peer.
+ * @param hostname of the peer that measured the latencies
+ * @param weights latency in microseconds by hostname of the neighbor
+ */
+void Client::handlePeerCommandLinkState(const std::string &hostname, const json &weights) {
+    for (const auto &item : weights.items()) {
+        topology.setLinkWeight(hostname, item.key(), item.value());
     }
 }
 
@@ -892,7 +1383,11 @@ void Client::handleInputCommandGetMembers(const std::string &groupname) {
 void Client::handleInputCommandNeighbors() {
     std::string neighbors;
     for (const auto &hostname : network.getNeighbors()) {
-        neighbors += hostname + ", ";
+        auto linkLatency = linkLatencies.find(hostname);
+        neighbors += hostname;
+        if (linkLatency != linkLatencies.end())
+            neighbors += " (" + std::to_string((int) linkLatency->second.smoothedRtt) + "us)";
+        neighbors += ", ";
     }
     if (neighbors.empty()) {
         logger.log("There are currently no neighbors.");
@@ -932,6 +1427,280 @@ void Client::handleInputCommandRoute(const std::string &targetNickname) {
     logger.log("Path: " + pathString);
 }
 
+/**
+ * Measure the rtt to every hop of the shortest path to a peer, to find its slowest link.
+ * @param targetNickname
+ * @param options count and interval of the probes
+ */
+void Client::handleInputCommandTraceroute(const std::string &targetNickname, const CommandOptions &options) {
+    std::string hostname = nicknames.reverseLookup(targetNickname);
+    if (hostname.empty()) {
+        logger.log("Unknown nickname passed.", LogType::WARN);
+        return;
+    }
+    if (hostname == network.getHostname()) {
+        logger.log("You cannot trace the route to yourself.", LogType::WARN);
+        return;
+    }
+
+    // the path starts with this peer
+    auto path = topology.getShortestPath(hostname);
+    if (path.size() < 2) {
+        logger.log("There is no route to '" + targetNickname + "'.", LogType::WARN);
+        return;
+    }
+    startProbes(std::vector<std::string>(path.begin() + 1, path.end()), options, true);
+}
+
+/**
+ * Start streaming synthetic data to a peer along its route, to measure the goodput of the overlay.
+ * @param targetNickname
+ * @param amount bytes with an optional k, M or G suffix, or seconds with an s suffix
+ */
+void Client::handleInputCommandBandwidthTest(const std::string &targetNickname, const std::string &amount) {
+    std::string hostname = nicknames.reverseLookup(targetNickname);
+    if (hostname.empty()) {
+        logger.log("Unknown nickname passed.", LogType::WARN);
+        return;
+    }
+    if (hostname == network.getHostname()) {
+        logger.log("You cannot test the bandwidth to yourself.", LogType::WARN);
+        return;
+    }
+    size_t bytes;
+    double seconds;
+    if (!parseAmount(amount, bytes, seconds)) {
+        logger.log("Invalid amount passed. Pass bytes, e.g. 100M, or seconds, e.g. 10s.", LogType::WARN);
+        return;
+    }
+    if (!bandwidthTest.target.empty()) logger.log("The former bandwidth test was cancelled.", LogType::WARN);
+
+    auto &test = bandwidthTest;
+    test.id++;
+    test.target = hostname;
+    test.bytes = bytes;
+    test.start = std::chrono::steady_clock::now();
+    test.end = test.start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(seconds));
+    test.streaming = true;
+    test.sent = 0;
+    test.sequence = 0;
+    test.cpuStart = processCpuSeconds();
+    logger.log("Testing the bandwidth to '" + targetNickname + "'.");
+}
+
+/**
+ * Parse the amount of a bandwidth test.
+ * @param amount e.g. 1000000, 100k, 10M, 1G or 10s
+ * @param bytes output, 0 if the amount is in seconds
+ * @param seconds output, 0 if the amount is in bytes
+ * @return false if the amount is invalid
+ */
+bool Client::parseAmount(const std::string &amount, size_t &bytes, double &seconds) {
+    bytes = 0;
+    seconds = 0;
+    size_t end = 0;
+    while (end < amount.size() && isdigit((unsigned char) amount[end])) end++;
+    if (end == 0 || end + 1 < amount.size() || end > 12) return false;
+
+    const double value = std::stod(amount.substr(0, end));
+    const char unit = end < amount.size() ? amount[end] : ' ';
+    switch (unit) {
+        case 's':
+            seconds = value;
+            return seconds > 0 && seconds <= 3600;
+        case ' ':
+            bytes = (size_t) value;
+            break;
+        case 'k':
+        case 'K':
+            bytes = (size_t) (value * 1e3);
+            break;
+        case 'M':
+            bytes = (size_t) (value * 1e6);
+            break;
+        case 'G':
+            bytes = (size_t) (value * 1e9);
+            break;
+        default:
+            return false;
+    }
+    return bytes > 0 && bytes <= 1e12;
+}
+
+/**
+ * Stream the chunks of a running bandwidth test for a time slice, or end a test without report after the timeout.
+ * Every BWTEST_TRACE_INTERVAL-th chunk records its hops. The last chunk asks the target for its report.
+ */
+void Client::maintainBandwidthTest() {
+    auto &test = bandwidthTest;
+    if (test.target.empty()) return;
+    auto now = std::chrono::steady_clock::now();
+    if (!test.streaming) {
+        if (now < test.end) return;
+        // without the report only the sending side is known
+        const double seconds = std::max(std::chrono::duration<double>(test.lastChunk - test.start).count(), 1e-6);
+        logger.log("No report of the bandwidth test from '" + nicknames.get(test.target) + "'. Sent " +
+                   std::to_string(test.sent) + " bytes in " + std::to_string(seconds) + "s (" +
+                   std::to_string(test.sent / 1e6 / seconds) + " MB/s), cpu " + std::to_string(test.cpu) + "s.",
+                   LogType::WARN);
+        test.target.clear();
+        return;
+    }
+
+    static const std::string data(BWTEST_CHUNK_SIZE, 'x');
+    const auto sliceEnd = now + std::chrono::milliseconds(BWTEST_SLICE);
+    while (now < sliceEnd) {
+        const bool last = test.bytes > 0 ? test.sent + BWTEST_CHUNK_SIZE >= test.bytes : now >= test.end;
+        const size_t size = test.bytes > 0 ? std::min<size_t>(BWTEST_CHUNK_SIZE, test.bytes - test.sent)
+                                           : BWTEST_CHUNK_SIZE;
+        // the chunks take the route of the data path, failed next hops are replaced like for messages
+        auto nextHops = getNextHops(test.target, true, false);
+        if (nextHops.empty()) {
+            logger.log("Lost the route to '" + nicknames.get(test.target) + "'. The bandwidth test was stopped.",
+                       LogType::WARN);
+            test.target.clear();
+            return;
+        }
+
+        json payload = {
+                {"target",   test.target},
+                {"test",     test.id},
+                {"sequence", test.sequence},
+                {"data",     size == BWTEST_CHUNK_SIZE ? data : data.substr(0, size)}
+        };
+        if (last) payload["last"] = true;
+        network.sendCommand(Type::BWTEST, payload, nextHops,
+                            test.sequence % BWTEST_TRACE_INTERVAL == 0 ? json::array() : json());
+        test.sent += size;
+        test.sequence++;
+        now = std::chrono::steady_clock::now();
+
+        if (last) {
+            test.cpu = processCpuSeconds() - test.cpuStart;
+            test.streaming = false;
+            test.lastChunk = now;
+            test.end = now + std::chrono::seconds(BWTEST_TIMEOUT);
+            return;
+        }
+    }
+}
+
+/**
+ * Forget the bandwidth tests of other peers without a chunk for BWTEST_TIMEOUT seconds, e.g. if the last one was lost.
+ */
+void Client::maintainBandwidthReceivers() {
+    const auto timeout = std::chrono::steady_clock::now() - std::chrono::seconds(BWTEST_TIMEOUT);
+    for (auto it = bandwidthReceivers.begin(); it != bandwidthReceivers.end();) {
+        if (it->second.latest >= timeout) {
+            ++it;
+            continue;
+        }
+        logger.log("The bandwidth test from '" + nicknames.get(it->first) + "' ended without its last chunk after " +
+                   std::to_string(it->second.bytes) + " bytes.", LogType::WARN);
+        it = bandwidthReceivers.erase(it);
+    }
+}
+
+/**
+ * Count a chunk of a bandwidth test and the queueing at its hops. The last chunk is answered with the report.
+ * @param origin hostname of the sending peer
+ * @param payload of the chunk
+ * @param hops records of a traced chunk, otherwise nullptr
+ */
+void Client::handlePeerCommandBandwidthTest(const std::string &origin, const json &payload, const json &hops) {
+    const auto now = std::chrono::steady_clock::now();
+    auto &receiver = bandwidthReceivers[origin];
+    const int id = payload["test"];
+    // a new test of the origin replaces its former one
+    if (receiver.id != id) {
+        receiver = BandwidthReceiver();
+        receiver.id = id;
+        receiver.first = now;
+        receiver.cpuStart = processCpuSeconds();
+    }
+    receiver.latest = now;
+    receiver.bytes += payload["data"].get_ref<const std::string &>().size();
+    receiver.chunks++;
+
+    if (hops.is_array()) {
+        const long wallNow = wallMicroseconds();
+        HopRecord record;
+        for (const auto &hop : hops) {
+            if (!readHop(hop, wallNow, record)) break;
+            auto statistics = std::find_if(receiver.hops.begin(), receiver.hops.end(),
+                                           [&record](const BandwidthReceiver::Hop &former) {
+                                               return former.hostname == record.hostname;
+                                           });
+            if (statistics == receiver.hops.end()) {
+                statistics = receiver.hops.insert(receiver.hops.end(), {record.hostname, 0, 0, 0});
+            }
+            statistics->queue += record.queue;
+            statistics->crypto += record.crypto;
+            statistics->count++;
+        }
+    }
+    if (!payload.value("last", false)) return;
+
+    const double seconds = std::chrono::duration<double>(now - receiver.first).count();
+    const double cpu = processCpuSeconds() - receiver.cpuStart;
+    json hopAverages = json::array();
+    for (const auto &hop : receiver.hops) {
+        hopAverages.push_back({hop.hostname, hop.queue / hop.count, hop.crypto / hop.count});
+    }
+    network.sendCommand(Type::BWREPORT, {
+            {"target",  origin},
+            {"test",    id},
+            {"bytes",   receiver.bytes},
+            {"lost",    (long) payload["sequence"] + 1 - receiver.chunks},
+            {"seconds", seconds},
+            {"cpu",     cpu},
+            {"hops",    hopAverages}
+    }, getNextHops(origin, true, false));
+    logger.log("Received a bandwidth test from '" + nicknames.get(origin) + "': " + std::to_string(receiver.bytes) +
+               " bytes in " + std::to_string(seconds) + "s.");
+    bandwidthReceivers.erase(origin);
+}
+
+/**
+ * Print the result of the own bandwidth test: the goodput, the cpu cost at both ends and the queueing per hop.
+ * The goodput is measured by this peer from the start until the report arrived.
+ * @param origin hostname of the tested peer
+ * @param payload of the report
+ */
+void Client::handlePeerCommandBandwidthReport(const std::string &origin, const json &payload) {
+    auto &test = bandwidthTest;
+    if (test.target != origin || test.streaming || payload["test"] != test.id) return;
+
+    auto format = [](double value) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.2f", value);
+        return std::string(buffer);
+    };
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - test.start).count();
+    const double megabytes = (double) payload["bytes"] / 1e6;
+    const double receiverSeconds = payload["seconds"], receiverCpu = payload["cpu"];
+
+    std::string report = "Bandwidth test to '" + nicknames.get(origin) + "': " + payload["bytes"].dump() +
+                         " bytes in " + format(elapsed) + "s, goodput " + format(megabytes / elapsed) + " MB/s (" +
+                         format(megabytes * 8 / elapsed) + " Mbit/s), " + payload["lost"].dump() + " chunks lost";
+    if (receiverSeconds > 0) {
+        report += "\n  receiver: " + format(megabytes / receiverSeconds) + " MB/s from the first to the last chunk";
+    }
+    if (megabytes > 0) {
+        report += "\n  cpu: sender " + format(test.cpu) + "s (" + format(test.cpu * 1000 / (test.sent / 1e6)) +
+                  " ms/MB), receiver " + format(receiverCpu) + "s (" + format(receiverCpu * 1000 / megabytes) +
+                  " ms/MB)";
+    }
+    for (const auto &hop : payload["hops"]) {
+        if (!hop.is_array() || hop.size() != 3 || !hop[0].is_string()) continue;
+        report += "\n  hop " + nicknames.get(hop[0]) + ": queue " + hop[1].dump() + "us, crypto " + hop[2].dump() +
+                  "us";
+    }
+    logger.log(report);
+    test.target.clear();
+}
+
 /**
  * Directly list the public key of a specific peer.
  * @param targetNickname
@@ -960,13 +1729,17 @@ void Client::handleInputCommandHelp() {
     logger.log("GETMEMBERS <name>: Lists all users of the group");
     logger.log("GETTOPIC <name>: Prints the current topic of the group");
     logger.log("SETTOPIC <name> <text>: Sets the current topic of the group");
-    logger.log("MSG <name> <text>: Message a single user or group");
+    logger.log("MSG [-t] <name> <text>: Message a single user or group, -t prints the latency of every hop");
     logger.log("NEIGHBORS: Lists direct Neighbors");
-    logger.log("PING <name/ip>: Determines availability and RTT to destination");
+    logger.log("PING [-t] [-c <count>] [-i <seconds>] <name/ip>: Determines availability and RTT to destination, "
+               "-t traces every hop of a single ping, -c sends a series with -i seconds in between");
+    logger.log("TRACEROUTE [-c <count>] [-i <seconds>] <name>: Measures the RTT to every hop of the route");
+    logger.log("BWTEST <name> <bytes|seconds>: Streams data to a peer and prints the goodput, e.g. 100M or 10s");
     logger.log("ROUTE <name>: Shows route to destination including individual hops or full routing table");
     logger.log("PLOT: Plots topology of the network to a file");
     logger.log("GETPUBLICKEY <name>: Print the public key of a specific peer");
     logger.log("GETKEYPAIR: Print the currently used public and private key");
+    logger.log("STATS: Print the counters, gauges and latency percentiles of this peer");
     logger.log("QUIT: Leave P2P Chat");
 }
 
@@ -1000,4 +1773,11 @@ std::string Client::popOutputMessage() {
     return logger.popOutputMessage();
 }
 
+/**
+ * Block until the client has messages to output.
+ */
+void Client::waitForOutput() {
+    logger.waitForOutput();
+}
+
 #pragma endregion
@@ -1,7 +1,7 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
-#include <queue>
+#include <chrono>
 #include <nlohmann/json.hpp>
 #include "Enums.h"
 #include "NetworkManager.h"
@@ -12,46 +12,148 @@
 #include "MessageManager.h"
 #include "IpManager.h"
 #include "CryptoManager.h"
+#include "CommandQueue.h"
+#include "CommandParser.h"
 
 using json = nlohmann::json;
 
 #define MULTICAST_PORT 5432
 #define PEER_PORT 6543
+#define LINK_PROBE_INTERVAL 2 // seconds between the latency measurements to the neighbors
+#define LINK_RTT_SMOOTHING 0.125 // weight of a new measurement in the smoothed rtt
+#define LINK_WEIGHT_HYSTERESIS 0.2 // relative change of the smoothed rtt before the routes are updated
+#define PROBE_TIMEOUT 2 // seconds to wait for the pongs after the last probe of /ping -c or /traceroute
+#define TRACEROUTE_PROBES 5 // probes per hop of /traceroute without -c
+#define PROBE_INTERVAL 1 // seconds between the probes of /ping -c or /traceroute without -i
+#define BWTEST_CHUNK_SIZE 16384 // bytes of synthetic data per message of /bwtest
+#define BWTEST_TRACE_INTERVAL 32 // every n-th chunk records its hops
+#define BWTEST_SLICE 5 // milliseconds the main loop streams chunks before it checks the sockets again
+#define BWTEST_TIMEOUT 10 // seconds to wait for the report after the last chunk, or for the next chunk of a test
 
 class Client {
 
 public:
     explicit Client(bool debug, uint16_t multicastPort = MULTICAST_PORT, uint16_t peerPort = PEER_PORT,
-                    const std::string &nickname = "");
+                    const std::string &nickname = "", const std::string &keyFile = "",
+                    KeyType keyType = KeyType::RSA, const std::string &statsFile = "");
+    ~Client();
 
     // methods
     void pushCommand(const std::string &command);
     bool hasOutput();
     std::string popOutputMessage();
+    void waitForOutput();
     void start();
 
 private:
+    // measured latency to a neighbor
+    struct LinkLatency {
+        double smoothedRtt; // in microseconds
+        int weight; // weight currently used for routing
+    };
+
+    // record of a hop of a traced message
+    struct HopRecord {
+        std::string hostname;
+        long received; // wall time in microseconds
+        long crypto; // microseconds spent opening the message
+        long queue; // microseconds spent waiting
+        long sent; // wall time in microseconds, now for the record of this peer
+    };
+
+    // pings of /ping -c or /traceroute, every round pings all targets once
+    struct ProbeSeries {
+        int id = 0; // changes with every series, pongs of former ones are ignored
+        bool traceroute = false;
+        std::vector<std::string> targets; // hostnames, the hops of a traceroute. Empty if no series is running
+        int count = 0; // rounds
+        int sent = 0; // rounds sent
+        std::chrono::microseconds interval{0};
+        std::vector<std::vector<double>> rtts; // by target, in milliseconds
+        std::vector<std::set<int>> sequences; // answered probes by target, duplicated pongs are ignored
+        std::chrono::steady_clock::time_point next; // next round or the timeout after the last one
+    };
+
+    // running /bwtest of this peer
+    struct BandwidthTest {
+        int id = 0; // changes with every test, reports of former ones are ignored
+        std::string target; // hostname, empty if no test is running
+        size_t bytes = 0; // to send, 0 if the test is timed
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end; // of the streaming, or the timeout of the report after it
+        bool streaming = false; // false: the last chunk is sent, waiting for the report
+        std::chrono::steady_clock::time_point lastChunk; // send of the last chunk
+        size_t sent = 0; // bytes of data
+        long sequence = 0; // next chunk
+        double cpuStart = 0; // process cpu time in seconds
+        double cpu = 0; // cpu seconds of the streaming
+    };
+
+    // /bwtest of another peer, that sends to this one
+    struct BandwidthReceiver {
+        // averages of the traced chunks at a hop
+        struct Hop {
+            std::string hostname;
+            long queue; // sum in microseconds
+            long crypto; // sum in microseconds
+            long count;
+        };
+
+        int id = 0;
+        std::chrono::steady_clock::time_point first; // receive of the first chunk
+        std::chrono::steady_clock::time_point latest; // receive of the latest chunk, for the timeout of the test
+        double cpuStart = 0;
+        size_t bytes = 0;
+        long chunks = 0;
+        std::vector<Hop> hops;
+    };
+
     // fields
     NetworkManager network;
     Logger &logger;
-    std::queue<std::string> inputCommandQueue; // Commands to be executed
+    CommandQueue inputCommandQueue; // Commands to be executed, filled by the input thread
     Topology topology;  // network structure
     GroupManager groups;
     NicknameManager nicknames;
     MessageManager messages;
     IpManager ips;
     std::string nickname;
+    std::map<std::string, LinkLatency> linkLatencies; // by hostname of the neighbor
+    std::map<std::string, long> linkReplyTimes; // microseconds the last link reply took to seal, by neighbor
+    std::chrono::steady_clock::time_point nextLinkProbe;
+    std::string statsFile; // Prometheus text file, empty if it is not written
+    std::chrono::steady_clock::time_point nextStatsWrite;
+    ProbeSeries probes;
+    BandwidthTest bandwidthTest;
+    std::map<std::string, BandwidthReceiver> bandwidthReceivers; // by hostname of the origin
 
     // methods
     void processInput();
-    void processCommand(Type type, std::string &target, const std::string &text);
-    std::set<std::string> getNextHops(const std::string &recipient, bool checkHostname, bool checkGroupname);
+    void processCommand(Type type, std::string &target, const std::string &text, const CommandOptions &options);
+    std::set<std::string> getNextHops(const std::string &recipient, bool checkHostname, bool checkGroupname,
+                                      const std::string &origin = "", const std::string &receivedFrom = "");
+    std::set<std::string> getRouteHops(const json &route);
+    void forwardToPeer(const json &message, const std::string &hostname, const std::string &receivedFrom);
     void receiveNetworkData();
+    void maintainLinks();
+    void writeStats();
+    void startProbes(const std::vector<std::string> &targets, const CommandOptions &options, bool traceroute);
+    void maintainProbes();
+    void handleProbeReply(const std::string &origin, const json &payload);
+    void logProbeStatistics();
+    void handleInputCommandBandwidthTest(const std::string &targetNickname, const std::string &amount);
+    void maintainBandwidthTest();
+    void maintainBandwidthReceivers();
+    void handlePeerCommandBandwidthTest(const std::string &origin, const json &payload, const json &hops);
+    void handlePeerCommandBandwidthReport(const std::string &origin, const json &payload);
+    static bool parseAmount(const std::string &amount, size_t &bytes, double &seconds);
+    static bool readHop(const json &hop, long now, HopRecord &record);
     void processMulticastMessage(json &message);
     void processPeerMessage(json &message);
     void processProposal(json &message);
     void executeProposal(const std::string &id);
     bool isRecipient(const std::string &hostname, const std::string &recipient);
+    void handleNetworkLeave(const std::set<std::string> &formerNeighbors);
     void handleNetworkFracture();
     void handleNetworkUnderconnected();
     void handlePeerCommandJoin(const std::string &hostname, const std::string &groupname);
@@ -67,8 +169,13 @@ private:
     void handleInputCommandGetMembers(const std::string &groupname);
     void handleInputCommandGetPublicKey(const std::string &targetNickname);
     void handleInputCommandNeighbors();
-    void handlePeerCommandPing(const std::string &origin, Type type, long timestamp);
+    void handlePeerCommandPing(const std::string &origin, Type type, const json &payload, const json &hops);
+    void logHops(const std::string &origin, const json &hops);
+    void handlePeerCommandLinkProbe(const std::string &hostname, long start, long received);
+    void handlePeerCommandLinkReply(const std::string &hostname, long start, long hold, long received);
+    void handlePeerCommandLinkState(const std::string &hostname, const json &weights);
     void handleInputCommandRoute(const std::string &targetNickname);
+    void handleInputCommandTraceroute(const std::string &targetNickname, const CommandOptions &options);
     void handlePeerCommandAddConnection(const json &payload);
     void handlePeerCommandRemovePeer(const std::string &payload);
 };
@@ -0,0 +1,239 @@
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <strings.h>
+#include "CommandParser.h"
+
+static const char *const WHITESPACE = " \t\n\v\f\r";
+
+/**
+ * Validate and parse a command, e.g. "/msg bob hello there". The command name is case insensitive.
+ * @param command without leading and trailing spaces
+ * @param type output
+ * @param target output, the first argument or empty
+ * @param text output, the second argument or the text of a message or empty
+ * @param options output, the entered options
+ * @return false if the command is invalid
+ */
+bool CommandParser::parse(const std::string &command, Type &type, std::string &target, std::string &text,
+                          CommandOptions &options) {
+    target.clear();
+    text.clear();
+    options = CommandOptions();
+    if (command.size() < 2 || command[0] != '/') return false;
+
+    size_t end = command.find_first_of(WHITESPACE, 1);
+    if (end == std::string::npos) end = command.size();
+    const Command *entry = lookup(command.data() + 1, end - 1);
+    if (entry == nullptr) return false;
+
+    size_t position = end;
+    while (readOption(command, position, *entry, options)) {}
+    switch (entry->arguments) {
+        case Arguments::NONE:
+            break;
+        case Arguments::WORD:
+            if (!readWord(command, position, target)) return false;
+            break;
+        case Arguments::OPTIONAL_WORD:
+            if (command.find_first_not_of(WHITESPACE, position) != std::string::npos &&
+                !readWord(command, position, target))
+                return false;
+            break;
+        case Arguments::ADDRESS:
+            if (!readWord(command, position, target, true)) return false;
+            break;
+        case Arguments::TWO_WORDS:
+            if (!readWord(command, position, target) || !readWord(command, position, text)) return false;
+            break;
+        case Arguments::WORD_TEXT: {
+            if (!readWord(command, position, target)) return false;
+            // the text is the rest, separated by at least one space
+            const size_t start = command.find_first_not_of(WHITESPACE, position);
+            if (start == position || start == std::string::npos) return false;
+            text.assign(command, start, std::string::npos);
+            position = command.size();
+            break;
+        }
+    }
+    // nothing may follow the arguments
+    if (command.find_first_not_of(WHITESPACE, position) != std::string::npos) return false;
+
+    type = entry->type;
+    return true;
+}
+
+/**
+ * Read an argument: whitespace followed by letters, digits and underscores.
+ * @param command
+ * @param position start, it is moved behind the word
+ * @param word output
+ * @param address true: colons are allowed too
+ * @return false if there is no whitespace or no word or the word ends with another character
+ */
+bool CommandParser::readWord(const std::string &command, size_t &position, std::string &word, bool address) {
+    const size_t start = command.find_first_not_of(WHITESPACE, position);
+    if (start == position || start == std::string::npos) return false;
+
+    size_t end = start;
+    while (end < command.size()) {
+        const char c = command[end];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' ||
+              (address && c == ':')))
+            break;
+        end++;
+    }
+    if (end == start) return false;
+    if (end < command.size() && !strchr(WHITESPACE, command[end])) return false;
+
+    word.assign(command, start, end - start);
+    position = end;
+    return true;
+}
+
+/**
+ * Read an option of the command: whitespace, a dash and one of its letters, e.g. -t, or with a value, e.g. -c 10.
+ * Values out of their range are invalid.
+ * @param command
+ * @param position start, it is moved behind the option
+ * @param entry of the command
+ * @param options output
+ * @return false if there is no option at the position. Unknown options are left for the arguments, which reject them
+ */
+bool CommandParser::readOption(const std::string &command, size_t &position, const Command &entry,
+                               CommandOptions &options) {
+    const size_t start = command.find_first_not_of(WHITESPACE, position);
+    if (start == position || start == std::string::npos || start + 1 >= command.size() || command[start] != '-' ||
+        !strchr(entry.options, command[start + 1]) || command[start + 1] == '\0')
+        return false;
+    if (start + 2 < command.size() && !strchr(WHITESPACE, command[start + 2])) return false;
+
+    size_t end = start + 2;
+    double value;
+    switch (command[start + 1]) {
+        case 't':
+            options.trace = true;
+            break;
+        case 'c':
+            if (!readNumber(command, end, value) || value < 1 || value > MAX_PROBE_COUNT || value != std::floor(value))
+                return false;
+            options.count = (int) value;
+            break;
+        case 'i':
+            if (!readNumber(command, end, value) || !(value >= MIN_PROBE_INTERVAL && value <= 3600)) return false;
+            options.interval = value;
+            break;
+        default:
+            return false;
+    }
+    position = end;
+    return true;
+}
+
+/**
+ * Read a decimal number after whitespace, e.g. 10 or 0.2.
+ * @param command
+ * @param position start, it is moved behind the number
+ * @param number output
+ * @return false if there is no whitespace or no number or the number ends with another character
+ */
+bool CommandParser::readNumber(const std::string &command, size_t &position, double &number) {
+    const size_t start = command.find_first_not_of(WHITESPACE, position);
+    if (start == position || start == std::string::npos || !isdigit((unsigned char) command[start])) return false;
+
+    char *end;
+    number = strtod(command.c_str() + start, &end);
+    const size_t stop = end - command.c_str();
+    if (stop < command.size() && !strchr(WHITESPACE, command[stop])) return false;
+
+    position = stop;
+    return true;
+}
+
+constexpr CommandParser::Command CommandParser::commands[] = {
+        {"join",         Type::JOIN,         Arguments::TWO_WORDS},
+        {"leave",        Type::LEAVE,        Arguments::WORD},
+        {"nick",         Type::NICK,         Arguments::WORD},
+        {"list",         Type::LIST,         Arguments::NONE},
+        {"gettopic",     Type::GETTOPIC,     Arguments::WORD},
+        {"settopic",     Type::SETTOPIC,     Arguments::WORD_TEXT},
+        {"msg",          Type::MSG,          Arguments::WORD_TEXT,     "t"},
+        {"quit",         Type::QUIT,         Arguments::NONE},
+        {"getmembers",   Type::GETMEMBERS,   Arguments::WORD},
+        {"neighbors",    Type::NEIGHBORS,    Arguments::NONE},
+        {"ping",         Type::PING,         Arguments::ADDRESS,       "tci"},
+        {"route",        Type::ROUTE,        Arguments::OPTIONAL_WORD},
+        {"plot",         Type::PLOT,         Arguments::NONE},
+        {"getpublickey", Type::GETPUBLICKEY, Arguments::WORD},
+        {"getkeypair",   Type::GETKEYPAIR,   Arguments::NONE},
+        {"help",         Type::HELP,         Arguments::OPTIONAL_WORD},
+        {"stats",        Type::STATS,        Arguments::NONE},
+        {"traceroute",   Type::TRACEROUTE,   Arguments::WORD,          "ci"},
+        {"bwtest",       Type::BWTEST,       Arguments::TWO_WORDS},
+};
+
+/**
+ * Perfect hash of the command names: length, first two and last character.
+ * @param name at least two characters
+ * @param length of the name
+ * @return slot in the table
+ */
+constexpr size_t CommandParser::hash(const char *name, size_t length) {
+    // setting the 0x20 bit lowers letters, other characters only have to stay deterministic
+    return (length + (unsigned char) (name[0] | 0x20) + (unsigned char) (name[1] | 0x20) +
+            8 * (size_t) (unsigned char) (name[length - 1] | 0x20)) & (COMMAND_TABLE_SIZE - 1);
+}
+
+/**
+ * Length of a null terminated name. Unlike strlen it can be evaluated at compile time.
+ * @param name
+ * @return length
+ */
+constexpr size_t CommandParser::nameLength(const char *name) {
+    size_t length = 0;
+    while (name[length] != '\0') length++;
+    return length;
+}
+
+/**
+ * Check that no two command names share a slot of the table.
+ * @return true if every slot holds at most one command
+ */
+constexpr bool CommandParser::isPerfectHash() {
+    const size_t count = sizeof(commands) / sizeof(commands[0]);
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t j = i + 1; j < count; ++j) {
+            if (hash(commands[i].name, nameLength(commands[i].name)) ==
+                hash(commands[j].name, nameLength(commands[j].name))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Find a command by its name.
+ * @param name case insensitive, not null terminated
+ * @param length of the name
+ * @return entry of the command or nullptr if there is none
+ */
+const CommandParser::Command *CommandParser::lookup(const char *name, size_t length) {
+    // a new name that collides fails the build, it has to change the hash or the table size
+    static_assert(isPerfectHash(), "Two command names collide in the command table.");
+    static const auto table = []() {
+        struct {
+            const Command *slots[COMMAND_TABLE_SIZE] = {};
+        } table;
+        for (const auto &command : commands) table.slots[hash(command.name, nameLength(command.name))] = &command;
+        return table;
+    }();
+
+    if (length < 3) return nullptr;
+    const Command *command = table.slots[hash(name, length)];
+    if (command == nullptr || strlen(command->name) != length || strncasecmp(command->name, name, length) != 0) {
+        return nullptr;
+    }
+    return command;
+}
+
@@ -0,0 +1,58 @@
+#ifndef COMMANDPARSER_H
+#define COMMANDPARSER_H
+
+#include <string>
+#include "Enums.h"
+
+#define COMMAND_TABLE_SIZE 64 // slots of the perfect hash over the command names, has to be a power of two
+#define MAX_PROBE_COUNT 10000 // probes of /ping -c and /traceroute -c
+#define MIN_PROBE_INTERVAL 0.01 // seconds between the probes of /ping -i
+
+// options entered between the command name and its arguments, e.g. /ping -t bob
+struct CommandOptions {
+    bool trace = false; // -t: every hop adds its latencies to the message
+    int count = 0; // -c: number of probes, 0 if it is not entered
+    double interval = 0; // -i: seconds between the probes, 0 if it is not entered
+};
+
+/**
+ * Validates and parses entered commands in a single pass, without regular expressions.
+ * The command name is looked up in a static table with a perfect hash.
+ */
+class CommandParser {
+public:
+    //statics
+    static bool parse(const std::string &command, Type &type, std::string &target, std::string &text,
+                      CommandOptions &options);
+
+private:
+    // arguments a command expects after its name
+    enum class Arguments {
+        NONE, // e.g. /quit
+        WORD, // e.g. /nick NAME, /traceroute NAME
+        OPTIONAL_WORD, // e.g. /help [COMMAND]
+        ADDRESS, // a word that may contain colons, e.g. /ping IPV6
+        WORD_TEXT, // e.g. /msg NAME TEXT
+        TWO_WORDS // e.g. /join GROUP KEY, /bwtest NAME 10M
+    };
+
+    struct Command {
+        const char *name; // lower case
+        Type type;
+        Arguments arguments;
+        const char *options = ""; // letters of the accepted options
+    };
+
+    //statics
+    static const Command commands[]; // the hash of their names is checked at compile time
+    static const Command *lookup(const char *name, size_t length);
+    static constexpr size_t hash(const char *name, size_t length);
+    static constexpr size_t nameLength(const char *name);
+    static constexpr bool isPerfectHash();
+    static bool readWord(const std::string &command, size_t &position, std::string &word, bool address = false);
+    static bool readOption(const std::string &command, size_t &position, const Command &entry,
+                           CommandOptions &options);
+    static bool readNumber(const std::string &command, size_t &position, double &number);
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include <thread>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "CommandQueue.h"
+
+#pragma region Constructor
+
+CommandQueue::CommandQueue() : fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {}
+
+CommandQueue::~CommandQueue() {
+    close(fd);
+}
+
+#pragma endregion
+
+/**
+ * Add a command. Only the input thread may call this. Waits while the queue is full.
+ * @param command
+ */
+void CommandQueue::push(std::string command) {
+    const size_t position = pushed.load(std::memory_order_relaxed);
+    // the user cannot type faster than the main thread processes, thus waiting is rare
+    while (position - popped.load(std::memory_order_acquire) == COMMAND_QUEUE_LENGTH) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    commands[position & (COMMAND_QUEUE_LENGTH - 1)].swap(command);
+    pushed.store(position + 1, std::memory_order_release);
+
+    uint64_t value = 1;
+    if (write(fd, &value, sizeof(value)) < 0) {}
+}
+
+/**
+ * Take the oldest command. Only the main thread may call this.
+ * @param command output
+ * @return false if the queue is empty
+ */
+bool CommandQueue::pop(std::string &command) {
+    const size_t position = popped.load(std::memory_order_relaxed);
+    if (position == pushed.load(std::memory_order_acquire)) return false;
+
+    command.swap(commands[position & (COMMAND_QUEUE_LENGTH - 1)]);
+    popped.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * Reset the eventfd before the queue is emptied. Commands pushed afterwards signal it again.
+ */
+void CommandQueue::clearSignal() {
+    uint64_t value;
+    if (read(fd, &value, sizeof(value)) < 0) {}
+}
@@ -0,0 +1,39 @@
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#define COMMAND_QUEUE_LENGTH 64 // commands waiting for the main thread, has to be a power of two
+
+/**
+ * Lock-free single producer, single consumer ring of the entered commands.
+ * The input thread pushes and the main thread pops. Every push signals an eventfd,
+ * thus the main thread can wait for commands in the same poll as for the sockets.
+ */
+class CommandQueue {
+public:
+    CommandQueue();
+    ~CommandQueue();
+    CommandQueue(const CommandQueue &) = delete;
+    CommandQueue &operator=(const CommandQueue &) = delete;
+
+    // methods
+    void push(std::string command);
+    bool pop(std::string &command);
+    void clearSignal();
+
+    // getter
+    int getFd() const { return fd; }
+
+private:
+    // fields
+    std::vector<std::string> commands = std::vector<std::string>(COMMAND_QUEUE_LENGTH);
+    std::atomic<size_t> pushed{0}; // only written by the input thread
+    char padding[64];
+    std::atomic<size_t> popped{0}; // only written by the main thread
+    int fd;
+};
+
+#endif
@@ -1,27 +1,65 @@
 #include "CryptoManager.h"
 #include "Helper.h"
+#include "Logger.h"
+#include "Metrics.h"
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <openssl/pem.h>
 #include <openssl/aes.h>
+#include <openssl/rand.h>
+#include <openssl/kdf.h>
 #include <algorithm>
 
-CryptoManager::CryptoManager(const std::string &hostname) {
-    generateKeyPair(hostname);
+// scratch buffers of a thread, reused by every message. They only grow up to the largest message.
+struct ScratchBuffers {
+    std::vector<unsigned char> encryptedKey;
+    std::vector<unsigned char> iv;
+    std::vector<unsigned char> message;
+    std::vector<unsigned char> decrypted;
+    std::vector<unsigned char> envelope;
 
+    static void ensure(std::vector<unsigned char> &buffer, size_t size) {
+        if (buffer.size() < size) buffer.resize(size);
+    }
+};
+
+static thread_local ScratchBuffers scratchBuffers;
+// index of the thread context, set by the crypto workers
+static thread_local size_t threadIndex = 0;
+
+CryptoManager::CryptoManager(const std::string &hostname, const std::string &keyFile, KeyType keyType) :
+        keyType(keyType) {
     // init aes
-    aesEncryptContext = EVP_CIPHER_CTX_new();
-    EVP_CIPHER_CTX_init(aesEncryptContext);
-    EVP_CipherInit_ex(aesEncryptContext, EVP_aes_256_cbc(), nullptr, nullptr, nullptr, 1);
-    aesKeyLength = EVP_CIPHER_CTX_key_length(aesEncryptContext);
-    aesIvLength = EVP_CIPHER_CTX_iv_length(aesEncryptContext);
+    aesKeyLength = EVP_CIPHER_key_length(EVP_aes_256_gcm());
+    aesIvLength = EVP_CIPHER_iv_length(EVP_aes_256_cbc());
     aesDecryptContext = EVP_CIPHER_CTX_new();
     EVP_CIPHER_CTX_init(aesDecryptContext);
 
-    // init rsa
-    rsaEncryptContext = EVP_CIPHER_CTX_new();
-    EVP_CIPHER_CTX_init(rsaEncryptContext);
-    rsaDecryptContext = EVP_CIPHER_CTX_new();
-    EVP_CIPHER_CTX_init(rsaDecryptContext);
+    // an existing key file is never overwritten, a broken one falls back to a key pair for this session
+    if (!keyFile.empty() && access(keyFile.c_str(), F_OK) == 0) {
+        if (!loadKeyPair(hostname, keyFile)) {
+            Logger::getInstance().log("Could not load the key pair from " + keyFile + ". Using a new one.",
+                                      LogType::ERROR);
+            generateKeyPair(hostname);
+        }
+    } else {
+        generateKeyPair(hostname);
+        if (!keyFile.empty() && !saveKeyPair(keyFile)) {
+            Logger::getInstance().log("Could not save the key pair to " + keyFile + ".", LogType::ERROR);
+        }
+    }
+}
+
+CryptoManager::~CryptoManager() {
+    for (auto &parsedPublicKey : parsedPublicKeys) {
+        EVP_PKEY_free(parsedPublicKey.second.key);
+        EVP_PKEY_free(parsedPublicKey.second.signingKey);
+    }
+    EVP_PKEY_free(parsedPrivateKey);
+    EVP_PKEY_free(signingPrivateKey);
+    EVP_CIPHER_CTX_free(aesDecryptContext);
 }
 
 /**
@@ -30,6 +68,7 @@ CryptoManager::CryptoManager(const std::string &hostname) {
  * @return public key or empty string if hostname is unknown
  */
 std::string CryptoManager::get(const std::string &hostname) const {
+    std::shared_lock<std::shared_timed_mutex> lock(publicKeysMutex);
     auto publicKey = publicKeys.find(hostname);
 
     if (publicKey == publicKeys.end()) return "";
@@ -37,12 +76,20 @@ std::string CryptoManager::get(const std::string &hostname) const {
 }
 
 /**
- * Add a new pair of hostname and public key.
+ * Add a new pair of hostname and public key. The key is parsed once here and not for every message.
  * @param hostname
- * @param publicKey
+ * @param publicKey in PEM format or the X25519 format
  * @return true if successful
  */
 bool CryptoManager::add(const std::string &hostname, const std::string &publicKey) {
+    std::lock_guard<std::shared_timed_mutex> lock(publicKeysMutex);
+    if (publicKeys.find(hostname) != publicKeys.end()) return false;
+
+    EVP_PKEY *signingKey = nullptr;
+    EVP_PKEY *parsedPublicKey = parsePublicKey(publicKey, signingKey);
+    if (parsedPublicKey == nullptr) return false;
+
+    parsedPublicKeys.emplace(hostname, PublicKey{parsedPublicKey, signingKey, hashString(publicKey)});
     return publicKeys.emplace(hostname, publicKey).second;
 }
 
@@ -52,9 +99,75 @@ bool CryptoManager::add(const std::string &hostname, const std::string &publicKe
  * @return true if successful
  */
 bool CryptoManager::remove(const std::string &hostname) {
+    std::lock_guard<std::shared_timed_mutex> lock(publicKeysMutex);
+    auto parsedPublicKey = parsedPublicKeys.find(hostname);
+    if (parsedPublicKey != parsedPublicKeys.end()) {
+        EVP_PKEY_free(parsedPublicKey->second.key);
+        EVP_PKEY_free(parsedPublicKey->second.signingKey);
+        parsedPublicKeys.erase(parsedPublicKey);
+    }
     return publicKeys.erase(hostname) > 0;
 }
 
+/**
+ * Set the index of the calling thread. Threads that use the same object at once need different indices.
+ * @param index below CRYPTO_MAX_THREADS, 0 is the main thread
+ */
+void CryptoManager::setThreadIndex(size_t index) {
+    threadIndex = index;
+}
+
+/**
+ * Get the contexts and sessions of the calling thread. They are created on the first use.
+ * @return context of the thread
+ */
+CryptoManager::ThreadContext &CryptoManager::getThreadContext() {
+    auto &threadContext = threadContexts[threadIndex];
+    if (!threadContext) {
+        threadContext.reset(new ThreadContext{CipherContext(EVP_CIPHER_CTX_new()), CipherContext(EVP_CIPHER_CTX_new()),
+                                              std::unique_ptr<EVP_PKEY_CTX, KeyContextDeleter>(
+                                                      EVP_PKEY_CTX_new_id(EVP_PKEY_X25519, nullptr)), {}, {}});
+        // every envelope for a X25519 key needs an ephemeral key
+        EVP_PKEY_keygen_init(threadContext->x25519KeygenContext.get());
+    }
+    return *threadContext;
+}
+
+/**
+ * Parse a public key in PEM format or the X25519 format.
+ * @param publicKey
+ * @param signingKey output, the Ed25519 key of the X25519 format or nullptr
+ * @return parsed key or nullptr if it is invalid
+ */
+EVP_PKEY *CryptoManager::parsePublicKey(const std::string &publicKey, EVP_PKEY *&signingKey) {
+    signingKey = nullptr;
+    const size_t prefixLength = strlen(X25519_KEY_PREFIX);
+
+    if (publicKey.compare(0, prefixLength, X25519_KEY_PREFIX) != 0) {
+        BIO *publicBIO = BIO_new_mem_buf(publicKey.c_str(), (int) publicKey.length());
+        EVP_PKEY *parsedPublicKey = PEM_read_bio_PUBKEY(publicBIO, nullptr, nullptr, nullptr);
+        BIO_free_all(publicBIO);
+        return parsedPublicKey;
+    }
+
+    std::vector<unsigned char> rawKeys;
+    if (base64Decode(publicKey.c_str() + prefixLength, publicKey.length() - prefixLength, rawKeys) !=
+        2 * X25519_KEY_LENGTH) {
+        return nullptr;
+    }
+    EVP_PKEY *parsedPublicKey = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, nullptr, rawKeys.data(),
+                                                            X25519_KEY_LENGTH);
+    signingKey = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, rawKeys.data() + X25519_KEY_LENGTH,
+                                             X25519_KEY_LENGTH);
+    if (parsedPublicKey == nullptr || signingKey == nullptr) {
+        EVP_PKEY_free(parsedPublicKey);
+        EVP_PKEY_free(signingKey);
+        signingKey = nullptr;
+        return nullptr;
+    }
+    return parsedPublicKey;
+}
+
 /**
  * Save or override a key for the groupname.
  * @param groupName
@@ -65,24 +178,26 @@ bool CryptoManager::setGroupKey(const std::string &groupName, const std::string
     // remove maybe old existing group keys
     groupKeys.erase(groupName);
 
-    auto *aesKey = (unsigned char *) malloc(aesKeyLength);
-    auto *aesIV = (unsigned char *) malloc(aesIvLength);
+    GroupKey groupKey{std::vector<unsigned char>(aesKeyLength), std::vector<unsigned char>(aesIvLength),
+                      CipherContext(EVP_CIPHER_CTX_new()), CipherContext(EVP_CIPHER_CTX_new()), {}, 0};
+    std::vector<unsigned char> aesPass(aesKeyLength, 0);
+    unsigned char aesSalt[8] = {};
 
-    auto *aesPass = (unsigned char *) malloc(aesKeyLength);
-    memset(aesPass, 0, aesKeyLength);
-    auto *aesSalt = (unsigned char *) malloc(8);
-    memset(aesSalt, 0, aesIvLength);
+    memcpy(aesPass.data(), key.c_str(), std::min(key.length(), aesKeyLength));
+    memcpy(aesSalt, key.c_str(), std::min(key.length(), sizeof(aesSalt)));
 
-    strncpy((char *) aesPass, key.c_str(), std::min(key.length(), aesKeyLength));
-    strncpy((char *) aesSalt, key.c_str(), std::min((int) key.length(), 8));
+    if (EVP_BytesToKey(EVP_aes_256_cbc(), EVP_sha256(), aesSalt, aesPass.data(), (int) aesKeyLength, 6,
+                       groupKey.key.data(), groupKey.iv.data()) == 0) {
+        return false;
+    }
 
-    if (EVP_BytesToKey(EVP_aes_256_cbc(), EVP_sha256(), aesSalt, aesPass, aesKeyLength, 6, aesKey, aesIV) == 0) {
+    // the key schedule is calculated once here, every message only sets its nonce
+    if (!EVP_EncryptInit_ex(groupKey.encryptContext.get(), EVP_aes_256_gcm(), nullptr, groupKey.key.data(), nullptr) ||
+        !EVP_DecryptInit_ex(groupKey.decryptContext.get(), EVP_aes_256_gcm(), nullptr, groupKey.key.data(), nullptr)) {
         return false;
     }
-    free(aesPass);
-    free(aesSalt);
 
-    return groupKeys.emplace(groupName, std::make_pair(aesKey, aesIV)).second;
+    return groupKeys.emplace(groupName, std::move(groupKey)).second;
 }
 
 /**
@@ -100,6 +215,7 @@ void CryptoManager::loadJson(const json &json) {
  * @return json of data
  */
 json CryptoManager::toJson() {
+    std::shared_lock<std::shared_timed_mutex> lock(publicKeysMutex);
     json j;
     for (const auto &element: publicKeys) {
         j.push_back({element.first, element.second});
@@ -108,207 +224,998 @@ json CryptoManager::toJson() {
 }
 
 /**
- * Encrypt the plaintext with the public key of the passed target hostname.
+ * Split an encrypted text into its '#' separated tokens without copying them.
+ * @param encryptedText
+ * @param tokens pointer and length of every token
+ * @param count expected number of tokens
+ * @return true if the text has exactly count tokens
+ */
+static bool splitTokens(const std::string &encryptedText, std::pair<const char *, size_t> *tokens, size_t count) {
+    size_t start = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t end = encryptedText.find('#', start);
+        if (i + 1 == count) {
+            // the last token has to reach the end
+            if (end != std::string::npos) return false;
+            end = encryptedText.length();
+        } else if (end == std::string::npos) {
+            return false;
+        }
+        tokens[i] = {encryptedText.c_str() + start, end - start};
+        start = end + 1;
+    }
+    return true;
+}
+
+/**
+ * Encrypt the plaintext with the public key of the passed target hostname into a binary envelope.
+ * The message is encrypted with AES-256-GCM, whose key is encrypted with the RSA public key
+ * or agreed on with the X25519 public key.
+ * Version and key id are authenticated as well.
  * @param plaintext
  * @param target hostname of the target peer
- * @return encrypted string or empty string on error
+ * @param envelope output, it is overwritten but its capacity is reused
+ * @return true if successful
  */
-std::string CryptoManager::publicEncrypt(const std::string &plaintext, const std::string &target) {
-    // get remote public key
-    std::string publicKeyString = get(target);
-    const char *publicKeyChar = publicKeyString.c_str();
-    BIO *publicBIO = BIO_new_mem_buf(publicKeyChar, -1);
-    EVP_PKEY *remotePubKey = PEM_read_bio_PUBKEY(publicBIO, nullptr, nullptr, nullptr);
-    BIO_free_all(publicBIO);
+bool CryptoManager::publicEncrypt(const std::string &plaintext, const std::string &target, std::string &envelope) {
+    static Histogram &sealTime = Metrics::getInstance().histogram("p2p_crypto_seal", "Sealing of a peer envelope");
+    ScopedTimer timer(sealTime);
+    envelope.clear();
 
-    // init
-    size_t encMsgLen = 0;
-    size_t blockLen = 0;
-    auto *ek = (unsigned char *) malloc(EVP_PKEY_size(remotePubKey));
-    auto *iv = (unsigned char *) malloc(EVP_MAX_IV_LENGTH);
+    // get remote public key, it stays valid while the lock is held
+    std::shared_lock<std::shared_timed_mutex> lock(publicKeysMutex);
+    auto parsedPublicKey = parsedPublicKeys.find(target);
+    if (parsedPublicKey == parsedPublicKeys.end()) return false;
+    EVP_PKEY *remotePubKey = parsedPublicKey->second.key;
+    if (EVP_PKEY_id(remotePubKey) == EVP_PKEY_X25519) {
+        return sealX25519Envelope(plaintext, target, parsedPublicKey->second, envelope);
+    }
 
-    size_t ekl = 0;
-    size_t ivl = EVP_MAX_IV_LENGTH;
-    size_t msgLen = plaintext.size() + 1;
-    auto *encMsg = (unsigned char *) malloc(msgLen + EVP_MAX_IV_LENGTH);
+    // init
+    auto &buffers = scratchBuffers;
+    EVP_CIPHER_CTX *envelopeEncryptContext = getThreadContext().envelopeEncryptContext.get();
+    buffers.ensure(buffers.encryptedKey, EVP_PKEY_size(remotePubKey));
+    unsigned char *ek = buffers.encryptedKey.data();
+    unsigned char nonce[ENVELOPE_NONCE_LENGTH];
+    int ekl = 0;
+    int blockLen = 0;
 
-    if (!EVP_SealInit(rsaEncryptContext, EVP_aes_256_cbc(), &ek, reinterpret_cast<int *>(&ekl), iv, &remotePubKey, 1)) {
-        return std::string();
+    if (!EVP_SealInit(envelopeEncryptContext, EVP_aes_256_gcm(), &ek, &ekl, nonce, &remotePubKey, 1)) {
+        return false;
     }
 
+    // header
+    const size_t headerLength = 1 + ENVELOPE_KEY_ID_LENGTH + 2 + ekl + ENVELOPE_NONCE_LENGTH + ENVELOPE_TAG_LENGTH;
+    envelope.resize(headerLength + plaintext.size());
+    auto *data = reinterpret_cast<unsigned char *>(&envelope[0]);
+    size_t offset = 0;
+    data[offset++] = ENVELOPE_VERSION;
+    for (int i = ENVELOPE_KEY_ID_LENGTH - 1; i >= 0; --i) data[offset++] = parsedPublicKey->second.id >> (i * 8);
+    data[offset++] = ekl >> 8;
+    data[offset++] = ekl;
+    memcpy(data + offset, ek, ekl);
+    offset += ekl;
+    memcpy(data + offset, nonce, ENVELOPE_NONCE_LENGTH);
+    offset += ENVELOPE_NONCE_LENGTH;
+    unsigned char *tag = data + offset;
+    offset += ENVELOPE_TAG_LENGTH;
+
     // encrypt
-    if (!EVP_SealUpdate(rsaEncryptContext, encMsg + encMsgLen, (int *) &blockLen,
-                        (const unsigned char *) plaintext.c_str(),(int) msgLen)) {
-        return std::string();
+    if (!EVP_SealUpdate(envelopeEncryptContext, nullptr, &blockLen, data, 1 + ENVELOPE_KEY_ID_LENGTH) ||
+        !EVP_SealUpdate(envelopeEncryptContext, data + offset, &blockLen, (const unsigned char *) plaintext.data(),
+                        (int) plaintext.size())) {
+        envelope.clear();
+        return false;
     }
-    encMsgLen += blockLen;
+    offset += blockLen;
 
-    if (!EVP_SealFinal(rsaEncryptContext, encMsg + encMsgLen, (int *) &blockLen)) {
-        return std::string();
+    if (!EVP_SealFinal(envelopeEncryptContext, data + offset, &blockLen) ||
+        !EVP_CIPHER_CTX_ctrl(envelopeEncryptContext, EVP_CTRL_GCM_GET_TAG, ENVELOPE_TAG_LENGTH, tag)) {
+        envelope.clear();
+        return false;
     }
-    encMsgLen += blockLen;
+    envelope.resize(offset + blockLen);
+    return true;
+}
 
-    return std::string(base64Encode(ek, ekl)) + "#" + std::to_string(ekl) + "#" + std::string(base64Encode(iv, ivl)) +
-           "#" + std::to_string(ivl) + "#" +
-           std::string(base64Encode(encMsg, encMsgLen)) + "#" + std::to_string(encMsgLen);
+/**
+ * Decrypt a binary envelope or the former text format with the local private key.
+ * @param encryptedText
+ * @param plaintext output, it is overwritten but its capacity is reused
+ * @return true if successful
+ */
+bool CryptoManager::privateDecrypt(const std::string &encryptedText, std::string &plaintext) {
+    static Histogram &openTime = Metrics::getInstance().histogram("p2p_crypto_open", "Opening of a peer envelope");
+    ScopedTimer timer(openTime);
+    const auto *envelope = reinterpret_cast<const unsigned char *>(encryptedText.data());
+    if (!encryptedText.empty() && encryptedText[0] == ENVELOPE_VERSION) {
+        return openEnvelope(envelope, encryptedText.size(), plaintext);
+    }
+    if (!encryptedText.empty() && encryptedText[0] == X25519_ENVELOPE_VERSION) {
+        return openX25519Envelope(envelope, encryptedText.size(), plaintext);
+    }
+    return privateDecryptLegacy(encryptedText, plaintext);
 }
 
 /**
- * Decrypt the passed encrypted string with the local private key.
- * @param encyptedText
- * @return plaintext or empty string on error
+ * Derive the AES-256-GCM key of a X25519 session with HKDF-SHA256 from the shared secret.
+ * Both public keys are the salt, thus every ephemeral key results in another key.
+ * @param privateKey own X25519 key
+ * @param peerKey X25519 public key of the other side
+ * @param ephemeralKey raw ephemeral public key
+ * @param recipientKey raw public key of the recipient
+ * @param context output, initialized with the derived key
+ * @param encrypt whether the context encrypts or decrypts
+ * @return true if successful
  */
-std::string CryptoManager::privateDecrypt(const std::string &encryptedText) {
-    auto tokens = split(encryptedText, '#');
-    unsigned char *ek, *iv, *encMsg;
-    base64Decode(tokens[0].c_str(), tokens[0].length(), &ek);
-    base64Decode(tokens[2].c_str(), tokens[2].length(), &iv);
-    base64Decode(tokens[4].c_str(), tokens[4].length(), &encMsg);
-    size_t encMsgLen = std::stoi(tokens[5]);
-    size_t ekl = std::stoi(tokens[1]); //ek length
-    size_t ivl = std::stoi(tokens[3]); //iv length
-
-    // get private key
-    const char *privateKeyChar = privateKey.c_str();
-    BIO *privateBIO = BIO_new_mem_buf(privateKeyChar, -1);
-    EVP_PKEY *privKey = PEM_read_bio_PrivateKey(privateBIO, nullptr, nullptr, nullptr);
-    BIO_free_all(privateBIO);
+static bool deriveX25519SessionKey(EVP_PKEY *privateKey, EVP_PKEY *peerKey, const unsigned char *ephemeralKey,
+                                   const unsigned char *recipientKey, EVP_CIPHER_CTX *context, bool encrypt) {
+    static const char info[] = "P2P-Chat X25519 envelope";
+    unsigned char sharedSecret[X25519_KEY_LENGTH];
+    unsigned char salt[2 * X25519_KEY_LENGTH];
+    unsigned char key[32];
+    size_t sharedSecretLength = sizeof(sharedSecret);
+    size_t keyLength = sizeof(key);
+    memcpy(salt, ephemeralKey, X25519_KEY_LENGTH);
+    memcpy(salt + X25519_KEY_LENGTH, recipientKey, X25519_KEY_LENGTH);
+
+    // fails for low order points, whose shared secret would be zero
+    EVP_PKEY_CTX *keyContext = EVP_PKEY_CTX_new(privateKey, nullptr);
+    bool success = keyContext != nullptr && EVP_PKEY_derive_init(keyContext) > 0 &&
+                   EVP_PKEY_derive_set_peer(keyContext, peerKey) > 0 &&
+                   EVP_PKEY_derive(keyContext, sharedSecret, &sharedSecretLength) > 0;
+    EVP_PKEY_CTX_free(keyContext);
+
+    keyContext = success ? EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr) : nullptr;
+    success = keyContext != nullptr && EVP_PKEY_derive_init(keyContext) > 0 &&
+              EVP_PKEY_CTX_set_hkdf_md(keyContext, EVP_sha256()) > 0 &&
+              EVP_PKEY_CTX_set1_hkdf_salt(keyContext, salt, sizeof(salt)) > 0 &&
+              EVP_PKEY_CTX_set1_hkdf_key(keyContext, sharedSecret, (int) sharedSecretLength) > 0 &&
+              EVP_PKEY_CTX_add1_hkdf_info(keyContext, (const unsigned char *) info, sizeof(info) - 1) > 0 &&
+              EVP_PKEY_derive(keyContext, key, &keyLength) > 0;
+    EVP_PKEY_CTX_free(keyContext);
+
+    // the key schedule is calculated once here, every message only sets its nonce
+    success = success && (encrypt ? EVP_EncryptInit_ex(context, EVP_aes_256_gcm(), nullptr, key, nullptr)
+                                  : EVP_DecryptInit_ex(context, EVP_aes_256_gcm(), nullptr, key, nullptr));
+    OPENSSL_cleanse(sharedSecret, sizeof(sharedSecret));
+    OPENSSL_cleanse(key, sizeof(key));
+    return success;
+}
+
+/**
+ * Encrypt the plaintext for a X25519 public key. The key is agreed on with an ephemeral key pair,
+ * that is kept for X25519_SESSION_MESSAGES messages to the target. Thus most messages only cost AES-GCM.
+ * Version, key id, ephemeral public key and nonce are authenticated as well.
+ * @param plaintext
+ * @param target hostname of the target peer
+ * @param publicKey of the target peer
+ * @param envelope output, it is overwritten but its capacity is reused
+ * @return true if successful
+ */
+bool CryptoManager::sealX25519Envelope(const std::string &plaintext, const std::string &target,
+                                       const PublicKey &publicKey, std::string &envelope) {
+    auto &threadContext = getThreadContext();
+    auto &sessions = threadContext.x25519SendSessions;
+    auto session = sessions.find(target);
+    // a new public key of the target needs a new session as well
+    if (session == sessions.end() || session->second.messages >= X25519_SESSION_MESSAGES ||
+        session->second.keyId != publicKey.id) {
+        X25519Session newSession{{}, CipherContext(EVP_CIPHER_CTX_new()), 0, publicKey.id};
+        unsigned char recipientKey[X25519_KEY_LENGTH];
+        size_t keyLength = X25519_KEY_LENGTH;
+
+        // the ephemeral private key is dropped right after the key agreement
+        EVP_PKEY *ephemeralKeyPair = nullptr;
+        bool success = EVP_PKEY_keygen(threadContext.x25519KeygenContext.get(), &ephemeralKeyPair) > 0 &&
+                       EVP_PKEY_get_raw_public_key(ephemeralKeyPair, newSession.ephemeralKey, &keyLength) > 0 &&
+                       EVP_PKEY_get_raw_public_key(publicKey.key, recipientKey, &keyLength) > 0 &&
+                       deriveX25519SessionKey(ephemeralKeyPair, publicKey.key, newSession.ephemeralKey, recipientKey,
+                                              newSession.context.get(), true);
+        EVP_PKEY_free(ephemeralKeyPair);
+        if (!success) return false;
+
+        // sessions of removed peers are dropped from time to time
+        if (sessions.size() >= X25519_MAX_SESSIONS) sessions.clear();
+        sessions.erase(target);
+        session = sessions.emplace(target, std::move(newSession)).first;
+    }
+    EVP_CIPHER_CTX *context = session->second.context.get();
+
+    const size_t headerLength = 1 + ENVELOPE_KEY_ID_LENGTH + X25519_KEY_LENGTH + ENVELOPE_NONCE_LENGTH +
+                                ENVELOPE_TAG_LENGTH;
+    envelope.resize(headerLength + plaintext.size());
+    auto *data = reinterpret_cast<unsigned char *>(&envelope[0]);
+    unsigned char *ephemeralKey = data + 1 + ENVELOPE_KEY_ID_LENGTH;
+    unsigned char *nonce = ephemeralKey + X25519_KEY_LENGTH;
+    unsigned char *tag = nonce + ENVELOPE_NONCE_LENGTH;
+    unsigned char *ciphertext = tag + ENVELOPE_TAG_LENGTH;
+    int blockLength = 0;
+    int ciphertextLength = 0;
+
+    data[0] = X25519_ENVELOPE_VERSION;
+    for (int i = 0; i < ENVELOPE_KEY_ID_LENGTH; ++i) data[ENVELOPE_KEY_ID_LENGTH - i] = publicKey.id >> (i * 8);
+    memcpy(ephemeralKey, session->second.ephemeralKey, X25519_KEY_LENGTH);
+    // every session has its own key, thus a counter is a unique nonce
+    const uint64_t counter = session->second.messages++;
+    memset(nonce, 0, ENVELOPE_NONCE_LENGTH);
+    for (int i = 0; i < 8; ++i) nonce[ENVELOPE_NONCE_LENGTH - 1 - i] = counter >> (i * 8);
+
+    if (!EVP_EncryptInit_ex(context, nullptr, nullptr, nullptr, nonce) ||
+        !EVP_EncryptUpdate(context, nullptr, &blockLength, data, (int) (tag - data)) ||
+        !EVP_EncryptUpdate(context, ciphertext, &blockLength, (const unsigned char *) plaintext.data(),
+                           (int) plaintext.size())) {
+        envelope.clear();
+        return false;
+    }
+    ciphertextLength += blockLength;
+
+    if (!EVP_EncryptFinal_ex(context, ciphertext + ciphertextLength, &blockLength) ||
+        !EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_GET_TAG, ENVELOPE_TAG_LENGTH, tag)) {
+        envelope.clear();
+        return false;
+    }
+    envelope.resize(headerLength + ciphertextLength + blockLength);
+    return true;
+}
+
+/**
+ * Decrypt a binary envelope for the local X25519 key. The envelope is read in place.
+ * The key of every ephemeral key is derived once and kept for the following messages of its session.
+ * @param envelope
+ * @param length of the envelope
+ * @param plaintext output, it is overwritten but its capacity is reused
+ * @return true if successful, false if the envelope is invalid, manipulated or for another key
+ */
+bool CryptoManager::openX25519Envelope(const unsigned char *envelope, size_t length, std::string &plaintext) {
+    plaintext.clear();
+
+    const size_t headerLength = 1 + ENVELOPE_KEY_ID_LENGTH + X25519_KEY_LENGTH + ENVELOPE_NONCE_LENGTH +
+                                ENVELOPE_TAG_LENGTH;
+    if (length < headerLength || envelope[0] != X25519_ENVELOPE_VERSION || keyType != KeyType::X25519) return false;
+
+    uint64_t keyId = 0;
+    for (size_t i = 1; i <= ENVELOPE_KEY_ID_LENGTH; ++i) keyId = keyId << 8 | envelope[i];
+    if (keyId != privateKeyId) return false;
+
+    const unsigned char *ephemeralKey = envelope + 1 + ENVELOPE_KEY_ID_LENGTH;
+    const unsigned char *nonce = ephemeralKey + X25519_KEY_LENGTH;
+    const unsigned char *tag = nonce + ENVELOPE_NONCE_LENGTH;
+    const unsigned char *ciphertext = tag + ENVELOPE_TAG_LENGTH;
+    const size_t ciphertextLength = length - headerLength;
+
+    const std::string sessionId(reinterpret_cast<const char *>(ephemeralKey), X25519_KEY_LENGTH);
+    auto &sessions = getThreadContext().x25519ReceiveSessions;
+    auto session = sessions.find(sessionId);
+    const bool newSession = session == sessions.end();
+    if (newSession) {
+        X25519Session receivedSession{{}, CipherContext(EVP_CIPHER_CTX_new()), 0, privateKeyId};
+        unsigned char recipientKey[X25519_KEY_LENGTH];
+        size_t keyLength = X25519_KEY_LENGTH;
+
+        EVP_PKEY *ephemeralPublicKey = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, nullptr, ephemeralKey,
+                                                                   X25519_KEY_LENGTH);
+        bool success = ephemeralPublicKey != nullptr &&
+                       EVP_PKEY_get_raw_public_key(parsedPrivateKey, recipientKey, &keyLength) > 0 &&
+                       deriveX25519SessionKey(parsedPrivateKey, ephemeralPublicKey, ephemeralKey, recipientKey,
+                                              receivedSession.context.get(), false);
+        EVP_PKEY_free(ephemeralPublicKey);
+        if (!success) return false;
+
+        // senders start new sessions regularly, thus old ones are dropped
+        if (sessions.size() >= X25519_MAX_SESSIONS) sessions.clear();
+        session = sessions.emplace(sessionId, std::move(receivedSession)).first;
+    }
+    EVP_CIPHER_CTX *context = session->second.context.get();
+
+    plaintext.resize(ciphertextLength);
+    auto *decryptedMessage = reinterpret_cast<unsigned char *>(&plaintext[0]);
+    int blockLength = 0;
+    int decryptedMessageLength = 0;
+
+    bool success = EVP_DecryptInit_ex(context, nullptr, nullptr, nullptr, nonce) &&
+                   EVP_DecryptUpdate(context, nullptr, &blockLength, envelope, (int) (tag - envelope)) &&
+                   EVP_DecryptUpdate(context, decryptedMessage, &blockLength, ciphertext, (int) ciphertextLength);
+    decryptedMessageLength += blockLength;
+
+    // fails if the tag does not match
+    success = success && EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_SET_TAG, ENVELOPE_TAG_LENGTH, (void *) tag) &&
+              EVP_DecryptFinal_ex(context, decryptedMessage + decryptedMessageLength, &blockLength);
+    if (!success) {
+        // forged envelopes must not fill the session cache
+        if (newSession) sessions.erase(session);
+        plaintext.clear();
+        return false;
+    }
+    plaintext.resize(decryptedMessageLength + blockLength);
+    return true;
+}
+
+/**
+ * Sign data with the local key. X25519 key pairs sign with their Ed25519 key, RSA key pairs with RSA-SHA256.
+ * @param data
+ * @param signature output, it is overwritten
+ * @return true if successful
+ */
+bool CryptoManager::sign(const std::string &data, std::string &signature) const {
+    return sign(reinterpret_cast<const unsigned char *>(data.data()), data.size(), signature);
+}
+
+/**
+ * Sign data with the local key.
+ * @param data
+ * @param length of the data
+ * @param signature output, it is overwritten
+ * @return true if successful
+ */
+bool CryptoManager::sign(const unsigned char *data, size_t length, std::string &signature) const {
+    EVP_PKEY *key = signingPrivateKey != nullptr ? signingPrivateKey : parsedPrivateKey;
+    if (key == nullptr) return false;
+
+    size_t signatureLength = EVP_PKEY_size(key);
+    signature.resize(signatureLength);
+    // Ed25519 hashes the data itself
+    const EVP_MD *digest = EVP_PKEY_id(key) == EVP_PKEY_ED25519 ? nullptr : EVP_sha256();
+    EVP_MD_CTX *context = EVP_MD_CTX_new();
+    bool success = context != nullptr && EVP_DigestSignInit(context, nullptr, digest, nullptr, key) > 0 &&
+                   EVP_DigestSign(context, (unsigned char *) &signature[0], &signatureLength, data, length) > 0;
+    EVP_MD_CTX_free(context);
+
+    signature.resize(success ? signatureLength : 0);
+    return success;
+}
+
+/**
+ * Verify the signature of data with the public key of a hostname.
+ * @param hostname
+ * @param data
+ * @param signature
+ * @return true if the signature is valid
+ */
+bool CryptoManager::verify(const std::string &hostname, const std::string &data, const std::string &signature) const {
+    return verify(hostname, reinterpret_cast<const unsigned char *>(data.data()), data.size(),
+                  reinterpret_cast<const unsigned char *>(signature.data()), signature.size());
+}
+
+/**
+ * Verify the signature of data with the public key of a hostname.
+ * @param hostname
+ * @param data
+ * @param length of the data
+ * @param signature
+ * @param signatureLength
+ * @return true if the signature is valid
+ */
+bool CryptoManager::verify(const std::string &hostname, const unsigned char *data, size_t length,
+                           const unsigned char *signature, size_t signatureLength) const {
+    std::shared_lock<std::shared_timed_mutex> lock(publicKeysMutex);
+    auto parsedPublicKey = parsedPublicKeys.find(hostname);
+    if (parsedPublicKey == parsedPublicKeys.end()) return false;
+    EVP_PKEY *key = parsedPublicKey->second.signingKey != nullptr ? parsedPublicKey->second.signingKey
+                                                                  : parsedPublicKey->second.key;
+    if (EVP_PKEY_id(key) == EVP_PKEY_X25519) return false;
+
+    const EVP_MD *digest = EVP_PKEY_id(key) == EVP_PKEY_ED25519 ? nullptr : EVP_sha256();
+    EVP_MD_CTX *context = EVP_MD_CTX_new();
+    bool success = context != nullptr && EVP_DigestVerifyInit(context, nullptr, digest, nullptr, key) > 0 &&
+                   EVP_DigestVerify(context, signature, signatureLength, data, length) > 0;
+    EVP_MD_CTX_free(context);
+    return success;
+}
+
+/**
+ * Build the frame of a group message. The text is encrypted once with the group key and the frame is signed,
+ * thus every hop forwards it unchanged and can check its origin without any decryption.
+ * @param header json of the message without the text
+ * @param plaintext
+ * @param groupName
+ * @param frame output, it is overwritten but its capacity is reused
+ * @return true if successful
+ */
+bool CryptoManager::sealGroupFrame(const std::string &header, const std::string &plaintext,
+                                   const std::string &groupName, std::string &frame) {
+    static Histogram &sealTime = Metrics::getInstance().histogram("p2p_crypto_group_frame_seal",
+                                                                  "Encryption and signing of a group frame");
+    ScopedTimer timer(sealTime);
+    std::string envelope, signature;
+    if (header.size() > 0xffff || !groupEncrypt(plaintext, groupName, envelope)) return false;
+
+    frame.clear();
+    frame.push_back((char) GROUP_FRAME_VERSION);
+    frame.push_back((char) (header.size() >> 8));
+    frame.push_back((char) header.size());
+    frame.append(header);
+    frame.append(envelope);
+    if (!sign(frame, signature) || signature.size() > 0xffff) return false;
+    frame.append(signature);
+    frame.push_back((char) (signature.size() >> 8));
+    frame.push_back((char) signature.size());
+    return true;
+}
+
+/**
+ * Check the signature of a group frame with the public key of its origin and convert it to its message.
+ * The group envelope is only base64 encoded, it stays encrypted.
+ * @param frame
+ * @param message output, header of the frame with the group envelope as text of the payload
+ * @return true if the frame is valid and its signature matches
+ */
+bool CryptoManager::openGroupFrame(const std::string &frame, json &message) const {
+    static Histogram &verifyTime = Metrics::getInstance().histogram("p2p_crypto_group_frame_verify",
+                                                                    "Signature check of a group frame");
+    ScopedTimer timer(verifyTime);
+    message = nullptr;
+    const auto *data = reinterpret_cast<const unsigned char *>(frame.data());
+    if (frame.size() < 5 || data[0] != GROUP_FRAME_VERSION) return false;
+
+    const size_t headerLength = data[1] << 8 | data[2];
+    const size_t signatureLength = data[frame.size() - 2] << 8 | data[frame.size() - 1];
+    if (3 + headerLength + signatureLength + 2 > frame.size()) return false;
+    const size_t signedLength = frame.size() - 2 - signatureLength;
+
+    // only group messages are sent in frames, the fields used before the message is checked have to be valid
+    json header = tryParse(frame.substr(3, headerLength));
+    if (!header.is_object() || header["type"] != static_cast<int>(Type::MSG) || !header["id"].is_string() ||
+        !header["origin"].is_string() || !header["payload"].is_object() ||
+        !header["payload"]["target"].is_string()) {
+        return false;
+    }
+    if (!verify((std::string) header["origin"], data, signedLength, data + signedLength, signatureLength)) {
+        return false;
+    }
+
+    std::string text;
+    base64Encode(data + 3 + headerLength, signedLength - 3 - headerLength, text);
+    header["payload"]["text"] = std::move(text);
+    message = std::move(header);
+    return true;
+}
+
+/**
+ * Open a message received from a peer: a signed group frame or a peer envelope.
+ * @param received frame or envelope
+ * @param decrypted buffer for the plaintext of an envelope, it is overwritten but its capacity is reused
+ * @param message output, nullptr if the message is invalid
+ * @return true if successful
+ */
+bool CryptoManager::openPeerMessage(const std::string &received, std::string &decrypted, json &message) {
+    if (!received.empty() && (unsigned char) received[0] == GROUP_FRAME_VERSION) {
+        return openGroupFrame(received, message);
+    }
+    if (!received.empty() && (unsigned char) received[0] == TRACED_FRAME_VERSION) {
+        message = nullptr;
+        const auto *data = reinterpret_cast<const unsigned char *>(received.data());
+        const size_t hopsLength = received.size() < 3 ? 0 : data[1] << 8 | data[2];
+        if (received.size() < 3 || 3 + hopsLength > received.size()) return false;
+        json hops = tryParse(received.substr(3, hopsLength));
+        if (!hops.is_array() || !openGroupFrame(received.substr(3 + hopsLength), message)) {
+            message = nullptr;
+            return false;
+        }
+        message["hops"] = std::move(hops);
+        return true;
+    }
+    message = privateDecrypt(received, decrypted) ? tryParse(decrypted) : nullptr;
+    return message != nullptr;
+}
+
+/**
+ * Wrap a group frame with the records of its hops. The signed frame stays unchanged.
+ * @param hops records of the hops
+ * @param frame signed or already traced group frame
+ * @param traced output, it is overwritten but its capacity is reused
+ * @return false if the frame is invalid or the records are too long
+ */
+bool CryptoManager::traceGroupFrame(const json &hops, const std::string &frame, std::string &traced) {
+    const auto *data = reinterpret_cast<const unsigned char *>(frame.data());
+    size_t offset = 0;
+    // the former records are replaced
+    if (frame.size() >= 3 && data[0] == TRACED_FRAME_VERSION) offset = 3 + (data[1] << 8 | data[2]);
+    const std::string records = hops.dump();
+    if (offset >= frame.size() || data[offset] != GROUP_FRAME_VERSION || records.size() > 0xffff) return false;
+
+    traced.clear();
+    traced.push_back((char) TRACED_FRAME_VERSION);
+    traced.push_back((char) (records.size() >> 8));
+    traced.push_back((char) records.size());
+    traced.append(records);
+    traced.append(frame, offset, std::string::npos);
+    return true;
+}
+
+/**
+ * Decrypt a binary envelope with the local private key. The envelope is read in place.
+ * @param envelope
+ * @param length of the envelope
+ * @param plaintext output, it is overwritten but its capacity is reused
+ * @return true if successful, false if the envelope is invalid, manipulated or for another key
+ */
+bool CryptoManager::openEnvelope(const unsigned char *envelope, size_t length, std::string &plaintext) {
+    plaintext.clear();
+
+    const size_t fixedLength = 1 + ENVELOPE_KEY_ID_LENGTH + 2;
+    if (length < fixedLength || envelope[0] != ENVELOPE_VERSION) return false;
+
+    uint64_t keyId = 0;
+    for (size_t i = 1; i <= ENVELOPE_KEY_ID_LENGTH; ++i) keyId = keyId << 8 | envelope[i];
+    if (keyId != privateKeyId) return false;
+
+    const size_t ekl = envelope[fixedLength - 2] << 8 | envelope[fixedLength - 1];
+    const size_t headerLength = fixedLength + ekl + ENVELOPE_NONCE_LENGTH + ENVELOPE_TAG_LENGTH;
+    if (length < headerLength) return false;
+    const unsigned char *ek = envelope + fixedLength;
+    const unsigned char *nonce = ek + ekl;
+    const unsigned char *tag = nonce + ENVELOPE_NONCE_LENGTH;
+    const unsigned char *ciphertext = tag + ENVELOPE_TAG_LENGTH;
+    const size_t ciphertextLength = length - headerLength;
+
+    int decLen = 0;
+    int blockLen = 0;
+    EVP_CIPHER_CTX *envelopeDecryptContext = getThreadContext().envelopeDecryptContext.get();
+    if (!EVP_OpenInit(envelopeDecryptContext, EVP_aes_256_gcm(), ek, (int) ekl, nonce, parsedPrivateKey)) {
+        return false;
+    }
+
+    plaintext.resize(ciphertextLength);
+    auto *decMsg = reinterpret_cast<unsigned char *>(&plaintext[0]);
+    if (!EVP_OpenUpdate(envelopeDecryptContext, nullptr, &blockLen, envelope, 1 + ENVELOPE_KEY_ID_LENGTH) ||
+        !EVP_OpenUpdate(envelopeDecryptContext, decMsg, &blockLen, ciphertext, (int) ciphertextLength)) {
+        plaintext.clear();
+        return false;
+    }
+    decLen += blockLen;
+
+    // fails if the tag does not match
+    if (!EVP_CIPHER_CTX_ctrl(envelopeDecryptContext, EVP_CTRL_GCM_SET_TAG, ENVELOPE_TAG_LENGTH, (void *) tag) ||
+        !EVP_OpenFinal(envelopeDecryptContext, decMsg + decLen, &blockLen)) {
+        plaintext.clear();
+        return false;
+    }
+    decLen += blockLen;
+
+    plaintext.resize(decLen);
+    return true;
+}
+
+/**
+ * Decrypt the former text format "ek#ekl#iv#ivl#message#messageLength" with the local private key.
+ * Only kept to read messages of peers that do not send envelopes yet.
+ * @param encryptedText
+ * @param plaintext output, it is overwritten but its capacity is reused
+ * @return true if successful
+ */
+bool CryptoManager::privateDecryptLegacy(const std::string &encryptedText, std::string &plaintext) {
+    plaintext.clear();
+
+    std::pair<const char *, size_t> tokens[6];
+    if (!splitTokens(encryptedText, tokens, 6)) return false;
+
+    auto &buffers = scratchBuffers;
+    size_t ekl = base64Decode(tokens[0].first, tokens[0].second, buffers.encryptedKey);
+    size_t ivl = base64Decode(tokens[2].first, tokens[2].second, buffers.iv);
+    size_t encMsgLen = base64Decode(tokens[4].first, tokens[4].second, buffers.message);
+    if (ivl < EVP_MAX_IV_LENGTH) return false;
 
     // init
-    size_t decLen = 0;
-    size_t blockLen = 0;
-    auto *decMsg = (unsigned char *) malloc(encMsgLen + ivl);
+    int decLen = 0;
+    int blockLen = 0;
+    buffers.ensure(buffers.decrypted, encMsgLen + EVP_MAX_BLOCK_LENGTH);
+    unsigned char *decMsg = buffers.decrypted.data();
+    EVP_CIPHER_CTX *envelopeDecryptContext = getThreadContext().envelopeDecryptContext.get();
 
-    if (!EVP_OpenInit(rsaDecryptContext, EVP_aes_256_cbc(), ek, ekl, iv, privKey)) {
-        return std::string();
+    if (!EVP_OpenInit(envelopeDecryptContext, EVP_aes_256_cbc(), buffers.encryptedKey.data(), (int) ekl,
+                      buffers.iv.data(), parsedPrivateKey)) {
+        return false;
     }
 
     // decrypt
-    if (!EVP_OpenUpdate(rsaDecryptContext, decMsg, (int *) &blockLen, encMsg, (int) encMsgLen)) {
-        return std::string();
+    if (!EVP_OpenUpdate(envelopeDecryptContext, decMsg, &blockLen, buffers.message.data(), (int) encMsgLen)) {
+        return false;
     }
     decLen += blockLen;
 
-    if (!EVP_OpenFinal(rsaDecryptContext, decMsg + decLen, reinterpret_cast<int *>(&blockLen))) {
-        return std::string();
+    if (!EVP_OpenFinal(envelopeDecryptContext, decMsg + decLen, &blockLen)) {
+        return false;
     }
     decLen += blockLen;
 
-    return std::string(reinterpret_cast<char *>(decMsg), decLen);
+    plaintext.assign(reinterpret_cast<char *>(decMsg), decLen);
+    return true;
 }
 
 /**
- * Encrypt the plaintext with the key of the passed group name.
+ * Encrypt the plaintext with the key of the passed group name into a binary envelope.
+ * Every message gets its own nonce and is authenticated together with the group name.
  * @param plaintext
  * @param groupName
- * @return
+ * @param envelope output, it is overwritten but its capacity is reused
+ * @return true if successful
  */
-std::string CryptoManager::groupEncrypt(const std::string &plaintext, const std::string &groupName) {
-    auto groupKey = groupKeys.find(groupName)->second;
-    size_t blockLength = 0;
-    size_t encryptedMessageLength = 0;
-    size_t msgLen = plaintext.size() + 1;
+bool CryptoManager::groupEncrypt(const std::string &plaintext, const std::string &groupName, std::string &envelope) {
+    envelope.clear();
+
+    auto groupKey = groupKeys.find(groupName);
+    if (groupKey == groupKeys.end()) return false;
+    EVP_CIPHER_CTX *context = groupKey->second.encryptContext.get();
 
-    auto *encryptedMessage = (unsigned char *) malloc(msgLen + AES_BLOCK_SIZE);
-    if (encryptedMessage == nullptr) {
-        return std::string();
+    // renew the random prefix of the nonce on the first message and every overflow of the counter
+    auto &nonceCounter = groupKey->second.nonceCounter;
+    if (nonceCounter == 0 && RAND_bytes(groupKey->second.nonce, ENVELOPE_NONCE_LENGTH - 4) != 1) return false;
+    nonceCounter++;
+
+    const size_t headerLength = 1 + ENVELOPE_NONCE_LENGTH + ENVELOPE_TAG_LENGTH;
+    envelope.resize(headerLength + plaintext.size());
+    auto *data = reinterpret_cast<unsigned char *>(&envelope[0]);
+    unsigned char *nonce = data + 1;
+    unsigned char *tag = nonce + ENVELOPE_NONCE_LENGTH;
+    unsigned char *ciphertext = tag + ENVELOPE_TAG_LENGTH;
+    int blockLength = 0;
+    int ciphertextLength = 0;
+    data[0] = GROUP_ENVELOPE_VERSION;
+    memcpy(nonce, groupKey->second.nonce, ENVELOPE_NONCE_LENGTH - 4);
+    for (int i = 0; i < 4; ++i) nonce[ENVELOPE_NONCE_LENGTH - 1 - i] = nonceCounter >> (i * 8);
+
+    // only the nonce is set, the key schedule stays
+    if (!EVP_EncryptInit_ex(context, nullptr, nullptr, nullptr, nonce) ||
+        !EVP_EncryptUpdate(context, nullptr, &blockLength, data, 1) ||
+        !EVP_EncryptUpdate(context, nullptr, &blockLength, (const unsigned char *) groupName.data(),
+                           (int) groupName.size()) ||
+        !EVP_EncryptUpdate(context, ciphertext, &blockLength, (const unsigned char *) plaintext.data(),
+                           (int) plaintext.size())) {
+        envelope.clear();
+        return false;
     }
+    ciphertextLength += blockLength;
 
-    // Encrypt it!
-    if (!EVP_EncryptInit_ex(aesEncryptContext, EVP_aes_256_cbc(), nullptr, groupKey.first, groupKey.second)) {
-        return std::string();
+    if (!EVP_EncryptFinal_ex(context, ciphertext + ciphertextLength, &blockLength) ||
+        !EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_GET_TAG, ENVELOPE_TAG_LENGTH, tag)) {
+        envelope.clear();
+        return false;
+    }
+    envelope.resize(headerLength + ciphertextLength + blockLength);
+    return true;
+}
+
+/**
+ * Decrypt a binary envelope or the former text format with the key of the passed group.
+ * @param envelope
+ * @param groupName
+ * @param plaintext output, it is overwritten but its capacity is reused
+ * @return true if successful
+ */
+bool CryptoManager::groupDecrypt(const std::string &envelope, const std::string &groupName, std::string &plaintext) {
+    if (!envelope.empty() && envelope[0] == GROUP_ENVELOPE_VERSION) {
+        return openGroupEnvelope(reinterpret_cast<const unsigned char *>(envelope.data()), envelope.size(),
+                                 groupName, plaintext);
     }
+    return groupDecryptLegacy(envelope, groupName, plaintext);
+}
+
+/**
+ * Decrypt a binary group envelope. The envelope is read in place.
+ * @param envelope
+ * @param length of the envelope
+ * @param groupName
+ * @param plaintext output, it is overwritten but its capacity is reused
+ * @return true if successful, false if the envelope is invalid, manipulated or for another group
+ */
+bool CryptoManager::openGroupEnvelope(const unsigned char *envelope, size_t length, const std::string &groupName,
+                                      std::string &plaintext) {
+    plaintext.clear();
+
+    auto groupKey = groupKeys.find(groupName);
+    if (groupKey == groupKeys.end()) return false;
+    EVP_CIPHER_CTX *context = groupKey->second.decryptContext.get();
+
+    const size_t headerLength = 1 + ENVELOPE_NONCE_LENGTH + ENVELOPE_TAG_LENGTH;
+    if (length < headerLength || envelope[0] != GROUP_ENVELOPE_VERSION) return false;
+    const unsigned char *nonce = envelope + 1;
+    const unsigned char *tag = nonce + ENVELOPE_NONCE_LENGTH;
+    const unsigned char *ciphertext = tag + ENVELOPE_TAG_LENGTH;
+    const size_t ciphertextLength = length - headerLength;
 
-    if (!EVP_EncryptUpdate(aesEncryptContext, encryptedMessage, (int *) &blockLength,
-                           (unsigned char *) plaintext.c_str(), (int) msgLen)) {
-        return std::string();
+    plaintext.resize(ciphertextLength);
+    auto *decryptedMessage = reinterpret_cast<unsigned char *>(&plaintext[0]);
+    int blockLength = 0;
+    int decryptedMessageLength = 0;
+
+    if (!EVP_DecryptInit_ex(context, nullptr, nullptr, nullptr, nonce) ||
+        !EVP_DecryptUpdate(context, nullptr, &blockLength, envelope, 1) ||
+        !EVP_DecryptUpdate(context, nullptr, &blockLength, (const unsigned char *) groupName.data(),
+                           (int) groupName.size()) ||
+        !EVP_DecryptUpdate(context, decryptedMessage, &blockLength, ciphertext, (int) ciphertextLength)) {
+        plaintext.clear();
+        return false;
     }
-    encryptedMessageLength += blockLength;
+    decryptedMessageLength += blockLength;
 
-    if (!EVP_EncryptFinal_ex(aesEncryptContext, encryptedMessage + encryptedMessageLength, (int *) &blockLength)) {
-        return std::string();
+    // fails if the tag does not match
+    if (!EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_SET_TAG, ENVELOPE_TAG_LENGTH, (void *) tag) ||
+        !EVP_DecryptFinal_ex(context, decryptedMessage + decryptedMessageLength, &blockLength)) {
+        plaintext.clear();
+        return false;
     }
+    decryptedMessageLength += blockLength;
 
-    return std::string(base64Encode(encryptedMessage, encryptedMessageLength + blockLength)) + "#" +
-           std::to_string(encryptedMessageLength + blockLength);
+    plaintext.resize(decryptedMessageLength);
+    return true;
 }
 
 /**
- * Decrypt the passed encrypted string with the key of the passed group.
- * @param encyptedText
- * @return plaintext or empty string on error
+ * Decrypt the former AES-CBC text format "message#messageLength" with the key of the passed group.
+ * Only kept to read messages of peers that do not send envelopes yet.
+ * @param encryptedText
+ * @param groupName
+ * @param plaintext output, it is overwritten but its capacity is reused
+ * @return true if successful
  */
-std::string CryptoManager::groupDecrypt(const std::string &encryptedText, const std::string &groupName) {
-    auto groupKey = groupKeys.find(groupName)->second;
-    unsigned char *encryptedMessage;
-    size_t decryptedMessageLength = 0;
-    size_t blockLength = 0;
+bool CryptoManager::groupDecryptLegacy(const std::string &encryptedText, const std::string &groupName,
+                                       std::string &plaintext) {
+    plaintext.clear();
 
-    auto tokens = split(encryptedText, '#');
-    base64Decode(tokens[0].c_str(), tokens[0].length(), &encryptedMessage);
-    size_t encryptedMessageLength = std::stoi(tokens[1]);
+    auto groupKey = groupKeys.find(groupName);
+    if (groupKey == groupKeys.end()) return false;
 
-    auto decryptedMessage = (unsigned char *) malloc(encryptedMessageLength);
-    if (decryptedMessage == nullptr) {
-        return std::string();
-    }
+    std::pair<const char *, size_t> tokens[2];
+    if (!splitTokens(encryptedText, tokens, 2)) return false;
+
+    auto &buffers = scratchBuffers;
+    size_t encryptedMessageLength = base64Decode(tokens[0].first, tokens[0].second, buffers.message);
+    int decryptedMessageLength = 0;
+    int blockLength = 0;
+    buffers.ensure(buffers.decrypted, encryptedMessageLength + AES_BLOCK_SIZE);
+    unsigned char *decryptedMessage = buffers.decrypted.data();
 
     // Decrypt it!
-    if (!EVP_DecryptInit_ex(aesDecryptContext, EVP_aes_256_cbc(), nullptr, groupKey.first, groupKey.second)) {
-        return std::string();
+    if (!EVP_DecryptInit_ex(aesDecryptContext, EVP_aes_256_cbc(), nullptr, groupKey->second.key.data(),
+                            groupKey->second.iv.data())) {
+        return false;
     }
 
-    if (!EVP_DecryptUpdate(aesDecryptContext, decryptedMessage, (int *) &blockLength, encryptedMessage,
+    if (!EVP_DecryptUpdate(aesDecryptContext, decryptedMessage, &blockLength, buffers.message.data(),
                            (int) encryptedMessageLength)) {
-        return std::string();
+        return false;
     }
     decryptedMessageLength += blockLength;
 
-    if (!EVP_DecryptFinal_ex(aesDecryptContext, decryptedMessage + decryptedMessageLength, (int *) &blockLength)) {
-        return std::string();
+    if (!EVP_DecryptFinal_ex(aesDecryptContext, decryptedMessage + decryptedMessageLength, &blockLength)) {
+        return false;
     }
     decryptedMessageLength += blockLength;
 
-    return std::string(reinterpret_cast<char *>(decryptedMessage), decryptedMessageLength);
+    plaintext.assign(reinterpret_cast<char *>(decryptedMessage), decryptedMessageLength);
+    return true;
+}
+
+/**
+ * Encrypt the plaintext with the public key of the passed target hostname.
+ * The envelope is base64 encoded, to be embedded in json messages.
+ * @param plaintext
+ * @param target hostname of the target peer
+ * @return encrypted string or empty string on error
+ */
+std::string CryptoManager::publicEncrypt(const std::string &plaintext, const std::string &target) {
+    std::string envelope, encryptedText;
+    if (!publicEncrypt(plaintext, target, envelope)) return encryptedText;
+    base64Encode(reinterpret_cast<const unsigned char *>(envelope.data()), envelope.size(), encryptedText);
+    return encryptedText;
+}
+
+/**
+ * Decrypt the passed encrypted string of publicEncrypt with the local private key.
+ * @param encryptedText base64 encoded envelope or the former text format
+ * @return plaintext or empty string on error
+ */
+std::string CryptoManager::privateDecrypt(const std::string &encryptedText) {
+    std::string plaintext;
+    if (encryptedText.find('#') != std::string::npos) {
+        privateDecryptLegacy(encryptedText, plaintext);
+        return plaintext;
+    }
+
+    auto &buffers = scratchBuffers;
+    size_t length = base64Decode(encryptedText.c_str(), encryptedText.length(), buffers.envelope);
+    openEnvelope(buffers.envelope.data(), length, plaintext);
+    return plaintext;
 }
 
 /**
- * Generate a keypair on initialization and save it.
+ * Encrypt the plaintext with the key of the passed group name.
+ * The envelope is base64 encoded, to be embedded in json messages.
+ * @param plaintext
+ * @param groupName
+ * @return encrypted string or empty string on error
+ */
+std::string CryptoManager::groupEncrypt(const std::string &plaintext, const std::string &groupName) {
+    std::string envelope, encryptedText;
+    if (!groupEncrypt(plaintext, groupName, envelope)) return encryptedText;
+    base64Encode(reinterpret_cast<const unsigned char *>(envelope.data()), envelope.size(), encryptedText);
+    return encryptedText;
+}
+
+/**
+ * Decrypt the passed encrypted string of groupEncrypt with the key of the passed group.
+ * @param encryptedText base64 encoded envelope or the former text format
+ * @param groupName
+ * @return plaintext or empty string on error
+ */
+std::string CryptoManager::groupDecrypt(const std::string &encryptedText, const std::string &groupName) {
+    std::string plaintext;
+    if (encryptedText.find('#') != std::string::npos) {
+        groupDecryptLegacy(encryptedText, groupName, plaintext);
+        return plaintext;
+    }
+
+    auto &buffers = scratchBuffers;
+    size_t length = base64Decode(encryptedText.c_str(), encryptedText.length(), buffers.envelope);
+    openGroupEnvelope(buffers.envelope.data(), length, groupName, plaintext);
+    return plaintext;
+}
+
+/**
+ * Generate a key pair of the given type without parameters.
+ * @param type EVP_PKEY_X25519 or EVP_PKEY_ED25519
+ * @return key pair or nullptr
+ */
+static EVP_PKEY *generateKey(int type) {
+    EVP_PKEY *keyPair = nullptr;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(type, nullptr);
+    if (ctx == nullptr || EVP_PKEY_keygen_init(ctx) <= 0 || EVP_PKEY_keygen(ctx, &keyPair) <= 0) keyPair = nullptr;
+    EVP_PKEY_CTX_free(ctx);
+    return keyPair;
+}
+
+/**
+ * Generate a keypair of the key type on initialization and save it.
  * @param hostname The hostname the public key is associated to
  */
 void CryptoManager::generateKeyPair(const std::string &hostname) {
-    // Init RSA
-    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
-    if (EVP_PKEY_keygen_init(ctx) <= 0) {
+    if (keyType == KeyType::X25519) {
+        EVP_PKEY *keyPair = generateKey(EVP_PKEY_X25519);
+        EVP_PKEY *signingKeyPair = generateKey(EVP_PKEY_ED25519);
+        if (keyPair == nullptr || signingKeyPair == nullptr) {
+            EVP_PKEY_free(keyPair);
+            EVP_PKEY_free(signingKeyPair);
+            return;
+        }
+        setKeyPair(hostname, keyPair, signingKeyPair);
         return;
     }
-    if (EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, RSA_KEYLEN) <= 0) {
+
+    // Init RSA
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    if (EVP_PKEY_keygen_init(ctx) <= 0 || EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, RSA_KEYLEN) <= 0) {
+        EVP_PKEY_CTX_free(ctx);
         return;
     }
 
     // generate keypair
     EVP_PKEY *localKeypair = nullptr;
     if (EVP_PKEY_keygen(ctx, &localKeypair) <= 0) {
+        EVP_PKEY_CTX_free(ctx);
         return;
     }
 
     EVP_PKEY_CTX_free(ctx);
+    setKeyPair(hostname, localKeypair);
+}
+
+/**
+ * Load the key pair from a PEM file, that only the current user may access.
+ * @param hostname The hostname the public key is associated to
+ * @param keyFile path of the file
+ * @return true if successful
+ */
+bool CryptoManager::loadKeyPair(const std::string &hostname, const std::string &keyFile) {
+    int fd = open(keyFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    // refuse private keys that others can read or replace, like ssh does
+    struct stat status{};
+    if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode) || status.st_uid != geteuid() ||
+        (status.st_mode & (S_IRWXG | S_IRWXO)) != 0) {
+        Logger::getInstance().log("The key file " + keyFile + " must be a file only accessible by its owner.",
+                                  LogType::ERROR);
+        close(fd);
+        return false;
+    }
+
+    std::string pem((size_t) status.st_size, '\0');
+    size_t offset = 0;
+    while (offset < pem.size()) {
+        ssize_t bytes = read(fd, &pem[offset], pem.size() - offset);
+        if (bytes <= 0) break;
+        offset += bytes;
+    }
+    close(fd);
+    if (offset != pem.size()) return false;
+
+    // the X25519 key type stores its Ed25519 key after the X25519 key
+    BIO *privateBIO = BIO_new_mem_buf(pem.c_str(), (int) pem.length());
+    EVP_PKEY *keyPair = PEM_read_bio_PrivateKey(privateBIO, nullptr, nullptr, nullptr);
+    EVP_PKEY *signingKeyPair = keyType == KeyType::X25519 ?
+                               PEM_read_bio_PrivateKey(privateBIO, nullptr, nullptr, nullptr) : nullptr;
+    BIO_free_all(privateBIO);
+    OPENSSL_cleanse(&pem[0], pem.size());
+
+    bool valid = keyType == KeyType::X25519 ?
+                 keyPair != nullptr && EVP_PKEY_id(keyPair) == EVP_PKEY_X25519 &&
+                 signingKeyPair != nullptr && EVP_PKEY_id(signingKeyPair) == EVP_PKEY_ED25519 :
+                 keyPair != nullptr && EVP_PKEY_id(keyPair) == EVP_PKEY_RSA;
+    if (!valid) {
+        Logger::getInstance().log("The key file " + keyFile + " does not contain a key pair of the chosen key type.",
+                                  LogType::ERROR);
+        EVP_PKEY_free(keyPair);
+        EVP_PKEY_free(signingKeyPair);
+        return false;
+    }
+
+    setKeyPair(hostname, keyPair, signingKeyPair);
+    return true;
+}
+
+/**
+ * Save the private key as PEM to a new file with the mode 0600.
+ * @param keyFile path of the file
+ * @return true if successful
+ */
+bool CryptoManager::saveKeyPair(const std::string &keyFile) const {
+    if (privateKey.empty()) return false;
+
+    int fd = open(keyFile.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0) return false;
 
+    size_t offset = 0;
+    while (offset < privateKey.size()) {
+        ssize_t bytes = write(fd, privateKey.data() + offset, privateKey.size() - offset);
+        if (bytes <= 0) break;
+        offset += bytes;
+    }
+
+    // a partially written key would be refused on the next start
+    bool success = offset == privateKey.size() && fsync(fd) == 0;
+    close(fd);
+    if (!success) unlink(keyFile.c_str());
+    return success;
+}
+
+/**
+ * Save the strings of a key pair and keep the parsed keys.
+ * RSA public keys are sent as PEM, X25519 public keys in the shorter X25519 format.
+ * @param hostname The hostname the public key is associated to
+ * @param keyPair parsed key pair, owned by this object afterwards
+ * @param signingKeyPair parsed Ed25519 key pair of the X25519 key type, owned by this object afterwards
+ */
+void CryptoManager::setKeyPair(const std::string &hostname, EVP_PKEY *keyPair, EVP_PKEY *signingKeyPair) {
+    BUF_MEM *bufferPtr;
     // save private key string
     BIO *privateBIO = BIO_new(BIO_s_mem());
-    PEM_write_bio_PrivateKey(privateBIO, localKeypair, nullptr, nullptr, 0, 0, nullptr);
-    int privateKeyLen = BIO_pending(privateBIO);
-    char *privateKeyChar = (char *) malloc(privateKeyLen);
-    BIO_read(privateBIO, privateKeyChar, privateKeyLen);
+    PEM_write_bio_PrivateKey(privateBIO, keyPair, nullptr, nullptr, 0, 0, nullptr);
+    if (signingKeyPair != nullptr) PEM_write_bio_PrivateKey(privateBIO, signingKeyPair, nullptr, nullptr, 0, 0, nullptr);
+    BIO_get_mem_ptr(privateBIO, &bufferPtr);
+    privateKey = std::string(bufferPtr->data, bufferPtr->length);
     BIO_free_all(privateBIO);
-    privateKey = privateKeyChar;
 
     // save public key string
-    BIO *publicBIO = BIO_new(BIO_s_mem());
-    PEM_write_bio_PUBKEY(publicBIO, localKeypair);
-    int publicKeyLen = BIO_pending(publicBIO);
-    char *publicKeyChar = (char *) malloc(publicKeyLen);
-    BIO_read(publicBIO, publicKeyChar, publicKeyLen);
-    BIO_free_all(publicBIO);
-    add(hostname, publicKeyChar);
+    std::string publicKey;
+    if (signingKeyPair != nullptr) {
+        unsigned char rawKeys[2 * X25519_KEY_LENGTH];
+        size_t keyLength = X25519_KEY_LENGTH;
+        EVP_PKEY_get_raw_public_key(keyPair, rawKeys, &keyLength);
+        EVP_PKEY_get_raw_public_key(signingKeyPair, rawKeys + X25519_KEY_LENGTH, &keyLength);
+        publicKey = X25519_KEY_PREFIX;
+        base64Encode(rawKeys, sizeof(rawKeys), publicKey);
+    } else {
+        BIO *publicBIO = BIO_new(BIO_s_mem());
+        PEM_write_bio_PUBKEY(publicBIO, keyPair);
+        BIO_get_mem_ptr(publicBIO, &bufferPtr);
+        publicKey = std::string(bufferPtr->data, bufferPtr->length);
+        BIO_free_all(publicBIO);
+    }
+    add(hostname, publicKey);
+    privateKeyId = hashString(publicKey);
+
+    // keep the parsed private keys for decryption and signatures
+    parsedPrivateKey = keyPair;
+    signingPrivateKey = signingKeyPair;
 }
@@ -3,21 +3,66 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <memory>
+#include <shared_mutex>
 #include <nlohmann/json.hpp>
 #include <openssl/evp.h>
+#include "Enums.h"
 
 using json = nlohmann::json;
 
 #define RSA_KEYLEN 2048
+#define CRYPTO_MAX_THREADS 65 // the main thread and up to 64 crypto workers
+
+// binary envelope of peer messages: version | key id | encrypted key length | encrypted key | nonce | tag | ciphertext
+#define ENVELOPE_VERSION 0x02
+#define ENVELOPE_KEY_ID_LENGTH 8
+#define ENVELOPE_NONCE_LENGTH 12
+#define ENVELOPE_TAG_LENGTH 16
+// binary envelope of peer messages for X25519 keys: version | key id | ephemeral public key | nonce | tag | ciphertext
+#define X25519_ENVELOPE_VERSION 0x03
+#define X25519_KEY_LENGTH 32
+#define X25519_SESSION_MESSAGES 65536 // messages to a peer before a new ephemeral key is used
+#define X25519_MAX_SESSIONS 4096 // received sessions that are kept
+// X25519 public keys are sent as this prefix and the base64 of the raw X25519 and Ed25519 public keys
+#define X25519_KEY_PREFIX "x25519:"
+// binary envelope of group messages: version | nonce | tag | ciphertext
+#define GROUP_ENVELOPE_VERSION 0x02
+// signed frame of group messages, forwarded unchanged by every hop:
+// version | header length | header | group envelope | signature | signature length
+#define GROUP_FRAME_VERSION 0x04
+// group frame of a traced message with the records of its hops, which are not signed, thus hops can add theirs:
+// version | hops length | hops json | group frame
+#define TRACED_FRAME_VERSION 0x05
 
 class CryptoManager {
 public:
-    explicit CryptoManager(const std::string &hostname);
+    explicit CryptoManager(const std::string &hostname, const std::string &keyFile = "",
+                           KeyType keyType = KeyType::RSA);
+    ~CryptoManager();
+    // the parsed keys are owned by this object
+    CryptoManager(const CryptoManager &) = delete;
+    CryptoManager &operator=(const CryptoManager &) = delete;
 
+    bool publicEncrypt(const std::string &plaintext, const std::string &target, std::string &encryptedText);
+    bool privateDecrypt(const std::string &encryptedText, std::string &plaintext);
+    bool groupEncrypt(const std::string &plaintext, const std::string &groupName, std::string &encryptedText);
+    bool groupDecrypt(const std::string &encryptedText, const std::string &groupName, std::string &plaintext);
     std::string publicEncrypt(const std::string &plaintext, const std::string &target);
     std::string privateDecrypt(const std::string &encryptedText);
     std::string groupEncrypt(const std::string &plaintext, const std::string &groupName);
     std::string groupDecrypt(const std::string &encryptedText, const std::string &groupName);
+    bool sign(const std::string &data, std::string &signature) const;
+    bool sign(const unsigned char *data, size_t length, std::string &signature) const;
+    bool verify(const std::string &hostname, const std::string &data, const std::string &signature) const;
+    bool verify(const std::string &hostname, const unsigned char *data, size_t length, const unsigned char *signature,
+                size_t signatureLength) const;
+    bool sealGroupFrame(const std::string &header, const std::string &plaintext, const std::string &groupName,
+                        std::string &frame);
+    bool openGroupFrame(const std::string &frame, json &message) const;
+    bool openPeerMessage(const std::string &received, std::string &decrypted, json &message);
+    static bool traceGroupFrame(const json &hops, const std::string &frame, std::string &traced);
 
     std::string get(const std::string &hostname) const;
     bool add(const std::string &hostname, const std::string &publicKey);
@@ -25,24 +70,88 @@ public:
     bool setGroupKey(const std::string &groupName, const std::string &key);
     void loadJson(const json &json);
     json toJson();
+    // Peer envelopes are sealed and opened by several threads at once, if every thread has its own index.
+    // Group keys and the own key pair are only used by the main thread, which has the index 0.
+    static void setThreadIndex(size_t index);
 
     // getter & setter
     const std::string &getPrivateKey() const { return privateKey; };
+    KeyType getKeyType() const { return keyType; }
 
 private:
+    // parsed public key and the id of its string, that identifies it in envelopes
+    struct PublicKey {
+        EVP_PKEY *key;
+        EVP_PKEY *signingKey; // Ed25519 key of X25519 peers, RSA keys sign themselves
+        uint64_t id;
+    };
+
+    struct CipherContextDeleter {
+        void operator()(EVP_CIPHER_CTX *context) const { EVP_CIPHER_CTX_free(context); }
+    };
+    using CipherContext = std::unique_ptr<EVP_CIPHER_CTX, CipherContextDeleter>;
+
+    // key of a group derived from the group password, with contexts that hold its key schedule
+    struct GroupKey {
+        std::vector<unsigned char> key;
+        std::vector<unsigned char> iv; // only used to read the former AES-CBC messages
+        CipherContext encryptContext;
+        CipherContext decryptContext;
+        // nonces are a random prefix and a counter. The prefix is renewed when the counter overflows
+        unsigned char nonce[ENVELOPE_NONCE_LENGTH];
+        uint32_t nonceCounter;
+    };
+
+    // key agreed on with an ephemeral X25519 key, with the context that holds its key schedule
+    struct X25519Session {
+        unsigned char ephemeralKey[X25519_KEY_LENGTH];
+        CipherContext context;
+        uint64_t messages;
+        uint64_t keyId; // id of the public key of the target
+    };
+
+    struct KeyContextDeleter {
+        void operator()(EVP_PKEY_CTX *context) const { EVP_PKEY_CTX_free(context); }
+    };
+
+    // contexts and X25519 sessions of one thread
+    struct ThreadContext {
+        CipherContext envelopeEncryptContext;
+        CipherContext envelopeDecryptContext;
+        std::unique_ptr<EVP_PKEY_CTX, KeyContextDeleter> x25519KeygenContext;
+        std::map<std::string, X25519Session> x25519SendSessions; // by hostname of the target
+        std::map<std::string, X25519Session> x25519ReceiveSessions; // by ephemeral public key
+    };
+
     std::map<std::string, std::string> publicKeys;
-    std::map<std::string, std::pair<unsigned char *, unsigned char *>> groupKeys;
+    std::map<std::string, PublicKey> parsedPublicKeys; // parsed once on add, used for every message
+    mutable std::shared_timed_mutex publicKeysMutex; // the main thread changes the public keys, workers read them
+    std::map<std::string, GroupKey> groupKeys;
+    std::unique_ptr<ThreadContext> threadContexts[CRYPTO_MAX_THREADS]; // created by their thread on first use
     std::string privateKey;
+    KeyType keyType;
+    EVP_PKEY *parsedPrivateKey = nullptr;
+    EVP_PKEY *signingPrivateKey = nullptr; // Ed25519 key of the X25519 key type
+    uint64_t privateKeyId = 0; // id of the own public key
     // used for aes
-    EVP_CIPHER_CTX *aesEncryptContext;
     EVP_CIPHER_CTX *aesDecryptContext;
     size_t aesKeyLength;
     size_t aesIvLength;
-    // used for rsa
-    EVP_CIPHER_CTX *rsaEncryptContext;
-    EVP_CIPHER_CTX *rsaDecryptContext;
 
+    ThreadContext &getThreadContext();
+    static EVP_PKEY *parsePublicKey(const std::string &publicKey, EVP_PKEY *&signingKey);
     void generateKeyPair(const std::string &hostname);
+    bool loadKeyPair(const std::string &hostname, const std::string &keyFile);
+    bool saveKeyPair(const std::string &keyFile) const;
+    void setKeyPair(const std::string &hostname, EVP_PKEY *keyPair, EVP_PKEY *signingKeyPair = nullptr);
+    bool sealX25519Envelope(const std::string &plaintext, const std::string &target, const PublicKey &publicKey,
+                            std::string &envelope);
+    bool openEnvelope(const unsigned char *envelope, size_t length, std::string &plaintext);
+    bool openX25519Envelope(const unsigned char *envelope, size_t length, std::string &plaintext);
+    bool privateDecryptLegacy(const std::string &encryptedText, std::string &plaintext);
+    bool openGroupEnvelope(const unsigned char *envelope, size_t length, const std::string &groupName,
+                           std::string &plaintext);
+    bool groupDecryptLegacy(const std::string &encryptedText, const std::string &groupName, std::string &plaintext);
 };
 
 #endif
@@ -0,0 +1,210 @@
+#include "CryptoWorkerPool.h"
+#include "Helper.h"
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#pragma region Constructor
+
+/**
+ * Start the workers.
+ * @param crypto used by all workers, every worker gets its own thread index
+ * @param workerCount number of threads, at most CRYPTO_MAX_THREADS - 1
+ * @param completionHandler called by the main thread for every processed job, in order per affinity
+ */
+CryptoWorkerPool::CryptoWorkerPool(CryptoManager &crypto, size_t workerCount,
+                                   std::function<void(CryptoJob &)> completionHandler) :
+        crypto(crypto),
+        completionHandler(std::move(completionHandler)),
+        mainWakeFd(eventfd(0, EFD_CLOEXEC)) {
+    workerCount = std::min<size_t>(workerCount, CRYPTO_MAX_THREADS - 1);
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back(new Worker());
+        workers.back()->wakeFd = eventfd(0, EFD_CLOEXEC);
+    }
+    // the threads are started after the vector is complete, because they access it
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers[i]->thread = std::thread(&CryptoWorkerPool::run, this, i);
+    }
+}
+
+/**
+ * Stop the workers. Jobs that are not collected yet are dropped.
+ */
+CryptoWorkerPool::~CryptoWorkerPool() {
+    running = false;
+    for (auto &worker : workers) wake(worker->wakeFd);
+    for (auto &worker : workers) {
+        worker->thread.join();
+        close(worker->wakeFd);
+    }
+    close(mainWakeFd);
+}
+
+#pragma endregion
+
+#pragma region MainThread
+
+/**
+ * Get the next free job of the worker for this affinity. If its ring is full, finished jobs are collected first.
+ * The job has to be filled and submitted before another one is prepared.
+ * @param affinity jobs with the same affinity are processed in order, e.g. the socket or hash of the hostname
+ * @return job to fill
+ */
+CryptoJob &CryptoWorkerPool::prepare(uint64_t affinity) {
+    preparedWorker = workers[affinity % workers.size()].get();
+    Worker &worker = *preparedWorker;
+
+    if (worker.submitted.load(std::memory_order_relaxed) - worker.collected == CRYPTO_QUEUE_LENGTH) {
+        block([&worker]() {
+            return worker.submitted.load(std::memory_order_relaxed) - worker.collected < CRYPTO_QUEUE_LENGTH;
+        });
+    }
+    return worker.jobs[worker.submitted.load(std::memory_order_relaxed) & (CRYPTO_QUEUE_LENGTH - 1)];
+}
+
+/**
+ * Hand the prepared job to its worker.
+ */
+void CryptoWorkerPool::submit() {
+    Worker &worker = *preparedWorker;
+    worker.submitted.store(worker.submitted.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+    // pairs with the check of the worker before it sleeps
+    if (worker.sleeping.load(std::memory_order_seq_cst)) wake(worker.wakeFd);
+}
+
+/**
+ * Pass all processed jobs to the completion handler, without waiting.
+ */
+void CryptoWorkerPool::collect() {
+    for (auto &worker : workers) {
+        const size_t processed = worker->processed.load(std::memory_order_acquire);
+        while (worker->collected != processed) {
+            completionHandler(worker->jobs[worker->collected & (CRYPTO_QUEUE_LENGTH - 1)]);
+            worker->collected++;
+        }
+    }
+}
+
+/**
+ * Wait until all submitted jobs are processed and collected.
+ */
+void CryptoWorkerPool::wait() {
+    block([this]() { return !hasPending(); });
+}
+
+/**
+ * Check for jobs that are not collected yet.
+ * @return true if there are some
+ */
+bool CryptoWorkerPool::hasPending() const {
+    for (auto &worker : workers) {
+        if (worker->submitted.load(std::memory_order_relaxed) != worker->collected) return true;
+    }
+    return false;
+}
+
+/**
+ * Count the jobs that are not collected yet.
+ * @return number of jobs
+ */
+size_t CryptoWorkerPool::pending() const {
+    size_t count = 0;
+    for (auto &worker : workers) count += worker->submitted.load(std::memory_order_relaxed) - worker->collected;
+    return count;
+}
+
+/**
+ * Collect jobs until the condition is true. Spins first and sleeps afterwards until a worker finishes a job.
+ * @param done condition
+ */
+void CryptoWorkerPool::block(const std::function<bool()> &done) {
+    auto hasProcessed = [this]() {
+        for (auto &worker : workers) {
+            if (worker->processed.load(std::memory_order_seq_cst) != worker->collected) return true;
+        }
+        return false;
+    };
+
+    for (size_t spins = 0;; ++spins) {
+        collect();
+        if (done()) return;
+        if (spins < CRYPTO_SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // pairs with the check of the workers after every job
+        mainSleeping.store(true, std::memory_order_seq_cst);
+        if (!hasProcessed()) {
+            uint64_t value;
+            if (read(mainWakeFd, &value, sizeof(value)) < 0) {}
+        }
+        mainSleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+#pragma endregion
+
+#pragma region Worker
+
+/**
+ * Loop of a worker. Processes its jobs in order and sleeps if there are none.
+ * @param index of the worker
+ */
+void CryptoWorkerPool::run(size_t index) {
+    CryptoManager::setThreadIndex(index + 1);
+    Worker &worker = *workers[index];
+    size_t spins = 0;
+
+    while (running.load(std::memory_order_relaxed)) {
+        const size_t next = worker.processed.load(std::memory_order_relaxed);
+        if (next == worker.submitted.load(std::memory_order_acquire)) {
+            if (++spins < CRYPTO_SPIN_COUNT) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // pairs with the check of the main thread after every submit
+            worker.sleeping.store(true, std::memory_order_seq_cst);
+            if (next == worker.submitted.load(std::memory_order_seq_cst) && running.load()) {
+                uint64_t value;
+                if (read(worker.wakeFd, &value, sizeof(value)) < 0) {}
+            }
+            worker.sleeping.store(false, std::memory_order_relaxed);
+            continue;
+        }
+
+        spins = 0;
+        process(worker.jobs[next & (CRYPTO_QUEUE_LENGTH - 1)]);
+        worker.processed.store(next + 1, std::memory_order_seq_cst);
+        if (mainSleeping.load(std::memory_order_seq_cst)) wake(mainWakeFd);
+    }
+}
+
+/**
+ * Open or seal the envelope of a job.
+ * @param job
+ */
+void CryptoWorkerPool::process(CryptoJob &job) {
+    if (job.kind == CryptoJob::Kind::SEAL) {
+        job.success = crypto.publicEncrypt(*job.plaintext, job.hostname, job.envelope);
+        return;
+    }
+
+    const long start = nowMicroseconds();
+    job.success = crypto.openPeerMessage(job.envelope, job.decrypted, job.message);
+    job.cryptoTime = nowMicroseconds() - start;
+    // add the hostname of the sending peer
+    if (job.success) job.message["receivedFrom"] = job.hostname;
+}
+
+/**
+ * Wake a thread that sleeps on an eventfd.
+ * @param fd
+ */
+void CryptoWorkerPool::wake(int fd) {
+    uint64_t value = 1;
+    if (write(fd, &value, sizeof(value)) < 0) {}
+}
+
+#pragma endregion
@@ -0,0 +1,90 @@
+#ifndef CRYPTOWORKERPOOL_H
+#define CRYPTOWORKERPOOL_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "CryptoManager.h"
+
+using json = nlohmann::json;
+
+#define CRYPTO_QUEUE_LENGTH 256 // jobs per worker, has to be a power of two
+#define CRYPTO_SPIN_COUNT 1000 // checks of an empty queue before a thread sleeps
+
+// job of a crypto worker. The jobs are reused, thus their strings keep their capacity
+struct CryptoJob {
+    enum class Kind {
+        OPEN, // decrypt and parse a received envelope or check a group frame
+        SEAL // encrypt a message for a next hop
+    };
+
+    Kind kind;
+    std::string hostname; // origin of an opened or target of a sealed envelope
+    int socket;
+    std::string envelope; // input of OPEN, output of SEAL. Group frames stay unchanged
+    const std::string *plaintext; // input of SEAL, has to stay valid until the job is collected
+    std::string decrypted; // buffer of OPEN
+    json message; // output of OPEN, nullptr if the envelope is invalid
+    long received; // wall time of the receive in microseconds, input of OPEN
+    long receivedAt; // steady time of the receive in microseconds, input of OPEN
+    long cryptoTime; // duration of the opening in microseconds, output of OPEN
+    bool success;
+};
+
+/**
+ * Workers that open and seal peer envelopes in parallel.
+ * Only the main thread submits and collects jobs. Every worker has a lock-free single producer, single consumer
+ * ring of jobs. Jobs with the same affinity go to the same worker, thus they are processed and collected in order.
+ */
+class CryptoWorkerPool {
+public:
+    CryptoWorkerPool(CryptoManager &crypto, size_t workerCount, std::function<void(CryptoJob &)> completionHandler);
+    ~CryptoWorkerPool();
+    CryptoWorkerPool(const CryptoWorkerPool &) = delete;
+    CryptoWorkerPool &operator=(const CryptoWorkerPool &) = delete;
+
+    // methods
+    CryptoJob &prepare(uint64_t affinity);
+    void submit();
+    void collect();
+    void wait();
+    bool hasPending() const;
+    size_t pending() const;
+
+    // getter
+    size_t size() const { return workers.size(); }
+
+private:
+    // ring of a worker. The indices only grow and every one is written by a single thread
+    struct Worker {
+        std::atomic<size_t> submitted{0}; // written by the main thread
+        char padding1[64];
+        std::atomic<size_t> processed{0}; // written by the worker
+        char padding2[64];
+        std::atomic<bool> sleeping{false};
+        size_t collected = 0; // only used by the main thread
+        int wakeFd = -1;
+        std::vector<CryptoJob> jobs = std::vector<CryptoJob>(CRYPTO_QUEUE_LENGTH);
+        std::thread thread;
+    };
+
+    CryptoManager &crypto;
+    std::function<void(CryptoJob &)> completionHandler;
+    std::vector<std::unique_ptr<Worker>> workers;
+    Worker *preparedWorker = nullptr;
+    std::atomic<bool> running{true};
+    std::atomic<bool> mainSleeping{false};
+    int mainWakeFd;
+
+    // methods
+    void run(size_t index);
+    void process(CryptoJob &job);
+    void block(const std::function<bool()> &done);
+    static void wake(int fd);
+};
+
+#endif
@@ -9,6 +9,11 @@ enum class LogType {
     DEBUG
 };
 
+enum class KeyType {
+    RSA,
+    X25519 // X25519 for encryption and Ed25519 for signatures
+};
+
 enum class Type {
     // Internal types
     INIT,
@@ -37,28 +42,16 @@ enum class Type {
     HELP,
     GETPUBLICKEY,
     GETKEYPAIR,
+    // Link state
+    LINKPROBE,
+    LINKREPLY,
+    LINKSTATE,
+    STATS,
+    TRACEROUTE,
+    // bandwidth test
+    BWTEST,
+    BWREPORT,
     INVALID
 };
 
-static Type convertToType(std::string s) {
-    for (auto &c: s) c = toupper(c);
-    if (s == "JOIN") return Type::JOIN;
-    if (s == "LEAVE") return Type::LEAVE;
-    if (s == "NICK") return Type::NICK;
-    if (s == "LIST") return Type::LIST;
-    if (s == "GETTOPIC") return Type::GETTOPIC;
-    if (s == "SETTOPIC") return Type::SETTOPIC;
-    if (s == "MSG") return Type::MSG;
-    if (s == "QUIT") return Type::QUIT;
-    if (s == "GETMEMBERS") return Type::GETMEMBERS;
-    if (s == "NEIGHBORS") return Type::NEIGHBORS;
-    if (s == "PING") return Type::PING;
-    if (s == "ROUTE") return Type::ROUTE;
-    if (s == "PLOT") return Type::PLOT;
-    if (s == "GETPUBLICKEY") return Type::GETPUBLICKEY;
-    if (s == "GETKEYPAIR") return Type::GETKEYPAIR;
-    if (s == "HELP") return Type::HELP;
-    return Type::INVALID;
-}
-
 #endif
@@ -9,6 +9,7 @@ Group::Group(const std::string &name, const std::string &admin) : name(name), ad
 */
 void Group::removeMember(const std::string &hostname) {
     members.erase(hostname);
+    treeOutdated = true;
     // check if new admin is needed
     if (!members.empty() && hostname == admin) {
         std::vector<std::string> membersCopy(members.begin(), members.end());
@@ -26,6 +27,27 @@ void Group::removeMember(const std::string &hostname) {
 */
 void Group::addMember(const std::string &hostname) {
     members.insert(hostname);
+    treeOutdated = true;
+}
+
+/**
+ * Cache the neighbors of this peer in the distribution tree.
+ * @param treeNeighbors hostnames of the neighbors in the tree
+ * @param topologyVersion version of the topology the tree was calculated for
+ */
+void Group::setTreeNeighbors(const std::set<std::string> &treeNeighbors, unsigned long topologyVersion) {
+    Group::treeNeighbors = treeNeighbors;
+    treeVersion = topologyVersion;
+    treeOutdated = false;
+}
+
+/**
+ * Check if the cached distribution tree has to be recalculated.
+ * @param topologyVersion current version of the topology
+ * @return true: members or topology changed since the last calculation
+ */
+bool Group::isTreeOutdated(unsigned long topologyVersion) const {
+    return treeOutdated || treeVersion != topologyVersion;
 }
 
 /**
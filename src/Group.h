@@ -25,6 +25,9 @@ public:
     const std::string &getAdmin() const { return admin; }
     const std::set<std::string> &getMembers() const { return members; }
     bool hasChangedAdmin() const { return changedAdmin; }
+    const std::set<std::string> &getTreeNeighbors() const { return treeNeighbors; }
+    void setTreeNeighbors(const std::set<std::string> &treeNeighbors, unsigned long topologyVersion);
+    bool isTreeOutdated(unsigned long topologyVersion) const;
 
 private:
     std::string name;
@@ -32,6 +35,11 @@ private:
     std::string admin;
     std::set<std::string> members;
     bool changedAdmin; // indicates if the last "removeMember" changed the admin
+
+    // cached neighbors of this peer in the distribution tree of the group
+    std::set<std::string> treeNeighbors;
+    unsigned long treeVersion = 0; // version of the topology the tree was calculated for
+    bool treeOutdated = true; // set on membership changes
 };
 
 #endif
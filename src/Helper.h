@@ -2,11 +2,14 @@
 #define HELPER_H
 
 #include <algorithm>
+#include <chrono>
 #include <cctype>
+#include <ctime>
 #include <locale>
 #include <sstream>
+#include <vector>
 #include <nlohmann/json.hpp>
-#include <openssl/pem.h>
+#include "Base64.h"
 
 using json = nlohmann::json;
 
@@ -94,67 +97,73 @@ static inline std::vector<std::string> split(const std::string &s, char delimite
     return tokens;
 }
 
-static inline char *base64Encode(const unsigned char *message, const size_t length) {
-    int encodedSize = 4 * ceil((double) length / 3);
-    char *b64text = (char *) malloc(encodedSize + 1);
-
-    if (b64text == nullptr) {
-        fprintf(stderr, "Failed to allocate memory\n");
-        exit(1);
-    }
-
-    BIO *b64 = BIO_new(BIO_f_base64());
-    BIO *bio = BIO_new(BIO_s_mem());
-    bio = BIO_push(b64, bio);
-    BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-
-    BIO_write(bio, message, length);
-    BIO_flush(bio);
-
-    BUF_MEM *bufferPtr;
-    BIO_get_mem_ptr(bio, &bufferPtr);
-    BIO_set_close(bio, BIO_CLOSE);
-
-    memcpy(b64text, (*bufferPtr).data, (*bufferPtr).length + 1);
-    b64text[(*bufferPtr).length] = '\0';
-
-    BIO_free_all(bio);
-    return b64text;
+/**
+ * Get the current time of the monotonic clock.
+ * @return microseconds
+ */
+static inline long nowMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-static inline int calcDecodeLength(const char *b64input, const size_t length) {
-    unsigned int padding = 0;
-
-    // Check for trailing '=''s as padding
-    if (b64input[length - 1] == '=' && b64input[length - 2] == '=') {
-        padding = 2;
-    } else if (b64input[length - 1] == '=') {
-        padding = 1;
-    }
-
-    return (int) length * 0.75 - padding;
+/**
+ * Get the cpu time used by all threads of the process.
+ * @return seconds
+ */
+static inline double processCpuSeconds() {
+    timespec time{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
 }
 
-static inline int base64Decode(const char *b64message, const size_t length, unsigned char **buffer) {
-    int decodedLength = calcDecodeLength(b64message, length);
-    *buffer = (unsigned char *) malloc(decodedLength + 1);
+/**
+ * Get the current time of the system clock, which is comparable between peers with synchronized clocks.
+ * @return microseconds since the epoch
+ */
+static inline long wallMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
 
-    if (*buffer == nullptr) {
-        fprintf(stderr, "Failed to allocate memory\n");
-        exit(1);
+/**
+ * Hash a string with FNV-1a. Unlike std::hash, the result is the same on every peer.
+ * @param s String to hash
+ * @return 64 bit hash
+ */
+static inline uint64_t hashString(const std::string &s) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : s) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
     }
+    return hash;
+}
 
-    BIO *bio = BIO_new_mem_buf(b64message, -1);
-    BIO *b64 = BIO_new(BIO_f_base64());
-    bio = BIO_push(b64, bio);
-    BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-
-    decodedLength = BIO_read(bio, *buffer, strlen(b64message));
-    (*buffer)[decodedLength] = '\0';
+/**
+ * Encode binary data to base64 without newlines.
+ * @param message binary data
+ * @param length of the data
+ * @param output the encoded string is appended to it
+ */
+static inline void base64Encode(const unsigned char *message, const size_t length, std::string &output) {
+    size_t offset = output.size();
+    output.resize(offset + Base64::encodedLength(length));
+    Base64::encode(message, length, &output[offset]);
+}
 
-    BIO_free_all(bio);
+/**
+ * Decode a base64 string without newlines.
+ * @param b64message base64 string
+ * @param length of the base64 string
+ * @param buffer the decoded data is written to it. It is only enlarged, thus it can be reused
+ * @return decoded length, 0 if the string is invalid
+ */
+static inline size_t base64Decode(const char *b64message, const size_t length, std::vector<unsigned char> &buffer) {
+    size_t decodedLength = Base64::decodedLength(b64message, length);
+    if (buffer.size() < decodedLength + 1) buffer.resize(decodedLength + 1);
 
-    return decodedLength;
+    long readLength = Base64::decode(b64message, length, buffer.data());
+    return readLength < 0 ? 0 : readLength;
 }
 
 #endif
@@ -1,9 +1,17 @@
 #include <thread>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include "Logger.h"
 
 #pragma region Constructor
 
-Logger::Logger() = default;
+Logger::Logger() : slots(new Slot[LOG_QUEUE_LENGTH]), wakeFd(eventfd(0, EFD_CLOEXEC)) {
+    for (size_t i = 0; i < LOG_QUEUE_LENGTH; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+Logger::~Logger() {
+    close(wakeFd);
+}
 
 Logger &Logger::getInstance() {
     // https://stackoverflow.com/questions/43523509/simple-singleton-example-in-c
@@ -17,35 +25,140 @@ Logger &Logger::getInstance() {
  * Shows if the Logger has messages to output.
  * @return true = has messages
  */
-bool Logger::hasOutput() {
-    return !messageQueue.empty();
+bool Logger::hasOutput() const {
+    const size_t position = dequeuePosition.load(std::memory_order_relaxed);
+    // sequentially consistent, it pairs with the producers before the output thread sleeps
+    return slots[position & (LOG_QUEUE_LENGTH - 1)].sequence.load(std::memory_order_seq_cst) == position + 1 ||
+           droppedMessages.load(std::memory_order_relaxed) > 0;
 }
 
 /**
- * Pop the first message from the outputMessageQueue.
- * @return The popped message
+ * Pop the first message from the outputMessageQueue. Only the output thread may call this.
+ * @return The popped message, empty if there is none
  */
 std::string Logger::popOutputMessage() {
-    auto message = messageQueue.front();
-    messageQueue.pop();
+    std::string message;
+    const size_t position = dequeuePosition.load(std::memory_order_relaxed);
+    Slot &slot = slots[position & (LOG_QUEUE_LENGTH - 1)];
+
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+        // the lost messages are reported once the queue is drained
+        const size_t dropped = droppedMessages.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) message = format(std::to_string(dropped) + " log messages were dropped.", LogType::WARN);
+        return message;
+    }
+    message.swap(slot.message);
+    // the slot is free for the next lap
+    slot.sequence.store(position + LOG_QUEUE_LENGTH, std::memory_order_release);
+    dequeuePosition.store(position + 1, std::memory_order_relaxed);
     return message;
 }
 
 /**
- * Add a string to the logger with time and type prefix.
+ * Block the output thread until there is a message to output.
+ */
+void Logger::waitForOutput() {
+    // pairs with the check of the producers after every push
+    outputSleeping.store(true, std::memory_order_seq_cst);
+    if (!hasOutput()) {
+        uint64_t value;
+        if (read(wakeFd, &value, sizeof(value)) < 0) {}
+    }
+    outputSleeping.store(false, std::memory_order_relaxed);
+}
+
+/**
+ * Add a message to the queue. Never blocks, the message is dropped if the queue is full.
+ * @param message moved into the queue
+ * @return true if it was queued
+ */
+bool Logger::push(std::string &message) {
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+        slot = &slots[position & (LOG_QUEUE_LENGTH - 1)];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            // claim the slot, on failure position is updated to the current one
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        } else if (sequence < position) {
+            // the output thread has not freed the slot of the last lap
+            droppedMessages.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+    slot->message.swap(message);
+    slot->sequence.store(position + 1, std::memory_order_seq_cst);
+
+    // pairs with the check of the output thread before it sleeps
+    if (outputSleeping.load(std::memory_order_seq_cst)) {
+        uint64_t value = 1;
+        if (write(wakeFd, &value, sizeof(value)) < 0) {}
+    }
+    return true;
+}
+
+/**
+ * Add a string to the logger with time and type prefix. Can be called by every thread.
  * @param message
  * @param type default is SYSTEM
  */
 void Logger::log(const std::string &message, const LogType type) {
-    if (!debug && type == LogType::DEBUG) return;
+    if (!isEnabled(type)) return;
+
+    std::string line = format(message, type);
+    push(line);
+}
+
+/**
+ * Add a literal to the logger. It is only copied into a string if its type is enabled.
+ * @param message
+ * @param type default is SYSTEM
+ */
+void Logger::log(const char *message, const LogType type) {
+    if (!isEnabled(type)) return;
+
+    std::string line = format(message, type);
+    push(line);
+}
+
+/**
+ * Write the traces to a binary log file instead of the output. Has to be called before other threads log.
+ * @param path of the file, it is overwritten
+ * @return true if successful
+ */
+bool Logger::openBinaryLog(const std::string &path) {
+    binaryLog.reset(new BinaryLog(path));
+    if (!binaryLog->isOpen()) binaryLog.reset();
+    return binaryLog != nullptr;
+}
 
-    time_t now = time(nullptr);
-    struct tm time{};
-    char buf[80];
-    time = *localtime(&now);
-    strftime(buf, sizeof(buf), "%X", &time);
+/**
+ * Prefix a message with the time and its type.
+ * @param message
+ * @param type
+ * @return line to output
+ */
+std::string Logger::format(const std::string &message, const LogType type) {
+    // the time only changes once per second, thus every thread keeps its last one
+    thread_local time_t cachedSecond = -1;
+    thread_local char timePrefix[80];
+    thread_local size_t timePrefixLength = 0;
+
+    const time_t now = time(nullptr);
+    if (now != cachedSecond) {
+        struct tm time{};
+        localtime_r(&now, &time);
+        timePrefix[0] = '[';
+        timePrefixLength = 1 + strftime(timePrefix + 1, sizeof(timePrefix) - 3, "%X", &time);
+        timePrefix[timePrefixLength++] = ']';
+        timePrefix[timePrefixLength++] = ' ';
+        cachedSecond = now;
+    }
 
-    std::string prefix;
+    const char *prefix = "";
     switch (type) {
         case LogType::WARN:
             prefix = "Warning: ";
@@ -63,7 +176,10 @@ void Logger::log(const std::string &message, const LogType type) {
             break;
     }
 
-    messageQueue.push("[" + std::string(buf) + "] " + prefix + message);
+    std::string line;
+    line.reserve(timePrefixLength + 10 + message.size());
+    line.append(timePrefix, timePrefixLength).append(prefix).append(message);
+    return line;
 }
 
 /**
@@ -75,4 +191,4 @@ void Logger::outputExit(int status) {
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
     exit(status);
-}
\ No newline at end of file
+}
@@ -2,28 +2,106 @@
 #define LOGGER_H
 
 #include <string>
-#include <queue>
+#include <atomic>
+#include <memory>
+#include <type_traits>
 #include "Enums.h"
+#include "BinaryLog.h"
+
+#define LOG_QUEUE_LENGTH 4096 // messages waiting for output, has to be a power of two
 
 class Logger {
 public:
     static Logger& getInstance();
+    ~Logger();
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
 
     // methods
-    bool hasOutput();
+    bool hasOutput() const;
     std::string popOutputMessage();
+    void waitForOutput();
     void log(const std::string& message, LogType type = LogType::NONE);
+    void log(const char *message, LogType type = LogType::NONE);
+    template<typename... Args>
+    void trace(TraceFormat trace, const Args &... args);
+    bool openBinaryLog(const std::string &path);
+    template<typename Build, typename = typename std::enable_if<!std::is_convertible<Build, std::string>::value>::type>
+    void log(Build build, LogType type);
     void outputExit(int status);
 
+    // getter
+    bool isEnabled(LogType type) const { return type != LogType::DEBUG || debug.load(std::memory_order_relaxed); }
+    bool isTracing() const { return binaryLog != nullptr || isEnabled(LogType::DEBUG); }
+    // the dequeue position is read first, thus it is never ahead of the enqueue position
+    size_t getQueueDepth() const {
+        const size_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+        return enqueuePosition.load(std::memory_order_relaxed) - dequeued;
+    }
+
     // setter
     void setDebug(bool value) { debug = value; }
 private:
     // private constructor
     Logger();
 
+    // slot of the queue. Its sequence tells whether it is free or holds a message of the current lap
+    struct Slot {
+        std::atomic<size_t> sequence;
+        std::string message;
+    };
+
     // fields
-    std::queue<std::string> messageQueue;
-    bool debug = false;
+    // bounded multi producer, single consumer queue. Only the output thread pops
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<size_t> enqueuePosition{0};
+    char padding[64];
+    std::atomic<size_t> dequeuePosition{0}; // only written by the output thread
+    std::atomic<size_t> droppedMessages{0}; // messages lost while the queue was full
+    std::atomic<bool> outputSleeping{false};
+    int wakeFd;
+    std::atomic<bool> debug{false}; // set after the crypto workers are started
+    std::unique_ptr<BinaryLog> binaryLog; // nullptr if the traces are debug messages, opened before other threads
+
+    // methods
+    bool push(std::string &message);
+
+    //statics
+    static std::string format(const std::string &message, LogType type);
 };
 
+/**
+ * Add a message, that is only built if its type is enabled.
+ * E.g. log([&]() { return "Received: " + message.dump(); }, LogType::DEBUG) costs nothing without debugging.
+ * @param build function returning the message
+ * @param type
+ */
+template<typename Build, typename>
+void Logger::log(Build build, const LogType type) {
+    if (!isEnabled(type)) return;
+
+    std::string line = format(build(), type);
+    push(line);
+}
+
+/**
+ * Add a trace of a hot path. It goes to the binary log if there is one, otherwise it is a debug message.
+ * Nothing is formatted for the binary log.
+ * @param trace format of the trace
+ * @param args strings and integers for the {} of the format
+ */
+template<typename... Args>
+void Logger::trace(TraceFormat trace, const Args &... args) {
+    if (!isTracing()) return;
+
+    BinaryLogRecord record;
+    BinaryLog::encode(record, trace, args...);
+    if (binaryLog != nullptr) {
+        binaryLog->push(record);
+        return;
+    }
+    std::string line = format(BinaryLog::decode(record, BinaryLog::getFormat(trace)), LogType::DEBUG);
+    push(line);
+}
+
 #endif
@@ -1,6 +1,7 @@
 #include <ctime>
 #include "MessageManager.h"
 #include "Enums.h"
+#include "Metrics.h"
 
 MessageManager::MessageManager() = default;
 
@@ -37,19 +38,24 @@ bool MessageManager::addProposal(const json &json) {
     if (json == nullptr || json.value("id", "").empty()) return false;
     if (getProposal((std::string) json["id"]) != nullptr) return false;
 
-    proposals.push_back({json, std::set<std::string>()});
+    proposals.push_back({json, std::set<std::string>(), std::chrono::steady_clock::now()});
     return true;
 }
 
 /**
  * Remove a proposal.
  * @param id of the proposal
+ * @param committed true: the proposal was executed, its latency since it was added is recorded
  */
-void MessageManager::removeProposal(const std::string &id) {
+void MessageManager::removeProposal(const std::string &id, bool committed) {
+    static Histogram &commitTime = Metrics::getInstance().histogram("p2p_proposal_commit",
+                                                                    "Time from a proposal to its execution");
     pruneOldProposals();
     proposals.erase(std::remove_if(proposals.begin(), proposals.end(),
-                                   [&id](const Proposal &proposal) {
-                                       return proposal.data["id"] == id;
+                                   [&](const Proposal &proposal) {
+                                       if (proposal.data["id"] != id) return false;
+                                       if (committed) commitTime.recordSince(proposal.added);
+                                       return true;
                                    }), proposals.end());
 }
 
@@ -72,10 +78,13 @@ int MessageManager::addProposalConfirmation(const std::string &id, const std::st
 
 /**
  * Check if the message id was already received.
+ * Messages can overtake each other on different paths, thus the last 64 ids of every peer are tracked.
  * @param id string with hostname and id
  * @return true = message already received
  */
 bool MessageManager::checkReceivedStatus(const std::string &id) {
+    static Counter &duplicates = Metrics::getInstance().counter("p2p_duplicate_messages_total",
+                                                                "Received messages that were dropped as duplicates");
     pruneOldProposals();
     auto split = id.find_last_of('-');
     auto hostname = id.substr(0, split);
@@ -84,17 +93,29 @@ bool MessageManager::checkReceivedStatus(const std::string &id) {
     auto iterator = messageIds.find(hostname);
     if (iterator == messageIds.end()) {
         // hostname is unknown
-        messageIds.emplace(hostname, number);
+        messageIds.emplace(hostname, ReceivedIds{number, 1});
         return false;
     }
 
-    if (iterator->second < number) {
+    auto &receivedIds = iterator->second;
+    if (receivedIds.highest < number) {
         // known id is smaller, thus the passed id is newer
-        iterator->second = number;
+        int shift = number - receivedIds.highest;
+        receivedIds.window = shift >= 64 ? 0 : receivedIds.window << shift;
+        receivedIds.window |= 1;
+        receivedIds.highest = number;
         return false;
     }
-    // passed id is smaller or equal and thus already known
-    return true;
+
+    // passed id is too old to be tracked and thus handled as known
+    int offset = receivedIds.highest - number;
+    uint64_t bit = offset >= 64 ? 0 : 1ULL << offset;
+    if (offset >= 64 || receivedIds.window & bit) {
+        duplicates.add();
+        return true;
+    }
+    receivedIds.window |= bit;
+    return false;
 }
 
 /**
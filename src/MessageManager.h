@@ -2,6 +2,7 @@
 #define PROPOSALMANAGER_H
 
 #include <nlohmann/json.hpp>
+#include <chrono>
 #include <set>
 
 using json = nlohmann::json;
@@ -11,6 +12,7 @@ public:
     struct Proposal {
         json data;
         std::set<std::string> confirmations;
+        std::chrono::steady_clock::time_point added; // for the commit latency
     };
 
     MessageManager();
@@ -18,16 +20,22 @@ public:
     // methods
     json getProposal(const std::string &id);
     bool addProposal(const json &json);
-    void removeProposal(const std::string &id);
+    void removeProposal(const std::string &id, bool committed = false);
     bool checkReceivedStatus(const std::string &id);
     void removeMessageId(const std::string &hostname);
     int addProposalConfirmation(const std::string &id, const std::string &origin);
     bool checkProposalBlocked(const json &message);
 
 private:
+    // received message ids of a peer
+    struct ReceivedIds {
+        int highest; // highest received id
+        uint64_t window; // bit i is set, if the id highest - i was received
+    };
+
     // fields
     std::vector<Proposal> proposals;
-    std::map<std::string, int> messageIds; // map of currently highest known message ids
+    std::map<std::string, ReceivedIds> messageIds; // received message ids by hostname
 
     // methods
     void pruneOldProposals();
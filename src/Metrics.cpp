@@ -0,0 +1,317 @@
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "Metrics.h"
+
+#pragma region Counter
+
+/**
+ * Add to the counter.
+ * @param value default is 1
+ */
+void Counter::add(uint64_t value) {
+    shards[Metrics::shard()].value.fetch_add(value, std::memory_order_relaxed);
+}
+
+/**
+ * Sum up the shards.
+ * @return current value
+ */
+uint64_t Counter::get() const {
+    uint64_t sum = 0;
+    for (const auto &shard : shards) sum += shard.value.load(std::memory_order_relaxed);
+    return sum;
+}
+
+#pragma endregion
+
+#pragma region Histogram
+
+/**
+ * Record a duration.
+ * @param nanoseconds
+ */
+void Histogram::record(uint64_t nanoseconds) {
+    Shard &shard = shards[Metrics::shard()];
+    shard.buckets[bucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    shard.count.fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+    // threads rarely share a shard, thus a lost race only loses a maximum of the same shard
+    if (nanoseconds > shard.max.load(std::memory_order_relaxed)) {
+        shard.max.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Record the duration since a start.
+ * @param start
+ */
+void Histogram::recordSince(std::chrono::steady_clock::time_point start) {
+    record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * Merge the shards.
+ * @return snapshot
+ */
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snapshot;
+    for (const auto &shard : shards) {
+        snapshot.count += shard.count.load(std::memory_order_relaxed);
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+        snapshot.max = std::max(snapshot.max, shard.max.load(std::memory_order_relaxed));
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+            snapshot.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+    return snapshot;
+}
+
+/**
+ * Estimate a quantile by the upper bound of its bucket.
+ * @param q between 0 and 1
+ * @return nanoseconds, at most the maximum
+ */
+uint64_t Histogram::Snapshot::quantile(double q) const {
+    if (count == 0) return 0;
+    const auto rank = (uint64_t) (q * (count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) return std::min(bucketUpperBound(i), max);
+    }
+    return max;
+}
+
+/**
+ * Bucket of a value. Values below HISTOGRAM_SUB_BUCKETS have their own bucket, every following
+ * power of two is split into HISTOGRAM_SUB_BUCKETS buckets by the bits after the highest one.
+ * @param value
+ * @return index of the bucket
+ */
+size_t Histogram::bucketIndex(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) return value;
+    const int subBits = __builtin_ctz(HISTOGRAM_SUB_BUCKETS);
+    const int highestBit = 63 - __builtin_clzll(value);
+    const int shift = highestBit - subBits;
+    return (highestBit - subBits + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * Largest value of a bucket.
+ * @param index of the bucket
+ * @return value
+ */
+uint64_t Histogram::bucketUpperBound(size_t index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) return index;
+    // the inverse of bucketIndex, the buckets of a group are 2^(group - 1) wide
+    const size_t group = index / HISTOGRAM_SUB_BUCKETS;
+    const uint64_t lowest = (HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << (group - 1);
+    return lowest + (1ULL << (group - 1)) - 1;
+}
+
+#pragma endregion
+
+#pragma region Constructor
+
+Metrics::Metrics() : lastStats(std::chrono::steady_clock::now()) {}
+
+Metrics &Metrics::getInstance() {
+    static Metrics instance;
+    return instance;
+}
+
+#pragma endregion
+
+/**
+ * Shard of the calling thread. The threads get the shards in turns.
+ * @return index
+ */
+size_t Metrics::shard() {
+    static std::atomic<size_t> nextShard{0};
+    thread_local size_t index = nextShard.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS;
+    return index;
+}
+
+/**
+ * Get or register a family of metrics.
+ * @param name
+ * @param help description
+ * @param kind
+ * @return family
+ */
+Metrics::Family &Metrics::getFamily(const std::string &name, const std::string &help, Kind kind) {
+    auto iterator = families.find(name);
+    if (iterator == families.end()) {
+        iterator = families.emplace(name, Family()).first;
+        iterator->second.kind = kind;
+        iterator->second.help = help;
+    }
+    return iterator->second;
+}
+
+/**
+ * Get or register a counter.
+ * @param name e.g. p2p_sent_messages_total
+ * @param help description
+ * @param labels e.g. peer="host", empty for none
+ * @return counter, it stays valid
+ */
+Counter &Metrics::counter(const std::string &name, const std::string &help, const std::string &labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &counter = getFamily(name, help, Kind::COUNTER).counters[labels];
+    if (!counter) counter.reset(new Counter());
+    return *counter;
+}
+
+/**
+ * Remove a counter. References to it become invalid.
+ * @param name e.g. p2p_link_sent_bytes_total
+ * @param labels e.g. peer="host"
+ */
+void Metrics::removeCounter(const std::string &name, const std::string &labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto family = families.find(name);
+    if (family == families.end()) return;
+    family->second.counters.erase(labels);
+    lastValues.erase(name + '{' + labels + '}');
+}
+
+/**
+ * Get or register a histogram of durations.
+ * @param name without unit, the export adds _seconds
+ * @param help description
+ * @return histogram, it stays valid
+ */
+Histogram &Metrics::histogram(const std::string &name, const std::string &help) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &family = getFamily(name, help, Kind::HISTOGRAM);
+    if (!family.histogram) family.histogram.reset(new Histogram());
+    return *family.histogram;
+}
+
+/**
+ * Register a gauge, e.g. a queue depth. The function is called by the thread that exports the metrics.
+ * @param name
+ * @param help description
+ * @param value function returning the current value
+ * @param owner object the function reads, it has to call removeGauges before it is destroyed
+ */
+void Metrics::gauge(const std::string &name, const std::string &help, std::function<double()> value,
+                    const void *owner) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &family = getFamily(name, help, Kind::GAUGE);
+    family.gauge = std::move(value);
+    family.gaugeOwner = owner;
+}
+
+/**
+ * Remove the gauges of an owner. A gauge registered again by another owner is kept.
+ * @param owner
+ */
+void Metrics::removeGauges(const void *owner) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto iterator = families.begin(); iterator != families.end();) {
+        if (iterator->second.kind == Kind::GAUGE && iterator->second.gaugeOwner == owner) {
+            iterator = families.erase(iterator);
+        } else {
+            ++iterator;
+        }
+    }
+}
+
+/**
+ * Readable summary for the /stats command. Counters show their rate since the last call.
+ * @return text with one metric per line
+ */
+std::string Metrics::toText() {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto now = std::chrono::steady_clock::now();
+    const double seconds = std::max(std::chrono::duration<double>(now - lastStats).count(), 1e-3);
+    lastStats = now;
+
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1);
+    for (const auto &item : families) {
+        const auto &family = item.second;
+        switch (family.kind) {
+            case Kind::COUNTER:
+                for (const auto &counter : family.counters) {
+                    const std::string name = counter.first.empty() ? item.first
+                                                                   : item.first + '{' + counter.first + '}';
+                    const uint64_t value = counter.second->get();
+                    uint64_t &lastValue = lastValues[name];
+                    text << "\n  " << name << ": " << value << " (" << (value - lastValue) / seconds << "/s)";
+                    lastValue = value;
+                }
+                break;
+            case Kind::GAUGE:
+                if (family.gauge) text << "\n  " << item.first << ": " << family.gauge();
+                break;
+            case Kind::HISTOGRAM: {
+                const auto snapshot = family.histogram->snapshot();
+                text << "\n  " << item.first << ": " << snapshot.count << " times, us p50 "
+                     << snapshot.quantile(0.5) / 1e3 << ", p90 " << snapshot.quantile(0.9) / 1e3 << ", p99 "
+                     << snapshot.quantile(0.99) / 1e3 << ", max " << snapshot.max / 1e3;
+                break;
+            }
+        }
+    }
+    return text.str();
+}
+
+/**
+ * Export all metrics in the Prometheus text format. Histograms are summaries in seconds.
+ * @return text
+ */
+std::string Metrics::toPrometheus() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream text;
+    text << std::setprecision(9);
+    for (const auto &item : families) {
+        const auto &family = item.second;
+        switch (family.kind) {
+            case Kind::COUNTER:
+                text << "# HELP " << item.first << ' ' << family.help << "\n# TYPE " << item.first << " counter\n";
+                for (const auto &counter : family.counters) {
+                    text << item.first;
+                    if (!counter.first.empty()) text << '{' << counter.first << '}';
+                    text << ' ' << counter.second->get() << '\n';
+                }
+                break;
+            case Kind::GAUGE:
+                if (!family.gauge) break;
+                text << "# HELP " << item.first << ' ' << family.help << "\n# TYPE " << item.first << " gauge\n"
+                     << item.first << ' ' << family.gauge() << '\n';
+                break;
+            case Kind::HISTOGRAM: {
+                const std::string name = item.first + "_seconds";
+                const auto snapshot = family.histogram->snapshot();
+                text << "# HELP " << name << ' ' << family.help << "\n# TYPE " << name << " summary\n";
+                for (const double q : {0.5, 0.9, 0.99}) {
+                    text << name << "{quantile=\"" << q << "\"} " << snapshot.quantile(q) / 1e9 << '\n';
+                }
+                text << name << "_sum " << snapshot.sum / 1e9 << '\n' << name << "_count " << snapshot.count << '\n';
+                break;
+            }
+        }
+    }
+    return text.str();
+}
+
+/**
+ * Write the Prometheus export to a file, e.g. for the textfile collector of the node exporter.
+ * The file is replaced at once, thus a scrape never reads a partial one.
+ * @param path of the file
+ * @return true if successful
+ */
+bool Metrics::writePrometheus(const std::string &path) {
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::trunc);
+        file << toPrometheus();
+        if (!file.flush()) return false;
+    }
+    return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
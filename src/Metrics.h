@@ -0,0 +1,138 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#define METRICS_SHARDS 16 // shards of a metric, threads update different ones
+#define METRICS_INTERVAL 10 // seconds between the writes of the Prometheus file
+#define HISTOGRAM_SUB_BUCKETS 8 // buckets per power of two, thus the error is at most 12.5%, has to be a power of two
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Counter that only grows. Every thread adds to its own shard, thus there is no contention.
+ */
+class Counter {
+public:
+    void add(uint64_t value = 1);
+    uint64_t get() const;
+
+private:
+    struct Shard {
+        std::atomic<uint64_t> value{0};
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    Shard shards[METRICS_SHARDS];
+};
+
+/**
+ * Histogram of durations in nanoseconds with logarithmic buckets, like an HDR histogram.
+ * Every thread records into its own shard.
+ */
+class Histogram {
+public:
+    void record(uint64_t nanoseconds);
+    void recordSince(std::chrono::steady_clock::time_point start);
+
+    // merged shards of a histogram
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t sum = 0; // nanoseconds
+        uint64_t max = 0;
+        uint64_t buckets[HISTOGRAM_BUCKETS] = {};
+
+        uint64_t quantile(double q) const;
+    };
+    Snapshot snapshot() const;
+
+private:
+    struct Shard {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+        std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+        char padding[64];
+
+        Shard() { for (auto &bucket : buckets) bucket.store(0, std::memory_order_relaxed); }
+    };
+    Shard shards[METRICS_SHARDS];
+
+    //statics
+    static size_t bucketIndex(uint64_t value);
+    static uint64_t bucketUpperBound(size_t index);
+};
+
+/**
+ * Records the time until the end of its scope into a histogram.
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram &histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { histogram.recordSince(start); }
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    Histogram &histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * Registry of all metrics, exported by /stats and as Prometheus text file.
+ * Metrics stay registered until they are removed, thus call sites can keep references to them.
+ * Counters with labels of a peer are removed when the peer disconnects, to keep their count bounded.
+ */
+class Metrics {
+public:
+    static Metrics &getInstance();
+
+    // methods
+    Counter &counter(const std::string &name, const std::string &help, const std::string &labels = "");
+    void removeCounter(const std::string &name, const std::string &labels);
+    Histogram &histogram(const std::string &name, const std::string &help);
+    void gauge(const std::string &name, const std::string &help, std::function<double()> value,
+               const void *owner);
+    void removeGauges(const void *owner);
+    std::string toText();
+    std::string toPrometheus();
+    bool writePrometheus(const std::string &path);
+
+    //statics
+    static size_t shard();
+
+private:
+    // private constructor
+    Metrics();
+
+    enum class Kind {
+        COUNTER,
+        GAUGE,
+        HISTOGRAM
+    };
+
+    // metrics with the same name, that differ in their labels
+    struct Family {
+        Kind kind;
+        std::string help;
+        std::map<std::string, std::unique_ptr<Counter>> counters; // by labels
+        std::unique_ptr<Histogram> histogram;
+        std::function<double()> gauge; // evaluated by the thread that exports
+        const void *gaugeOwner = nullptr; // object the gauge reads, it removes the gauge before its destruction
+    };
+
+    // fields
+    std::mutex mutex; // registration and export
+    std::map<std::string, Family> families; // by name
+    std::map<std::string, uint64_t> lastValues; // of the counters at the last /stats, for their rates
+    std::chrono::steady_clock::time_point lastStats;
+
+    // methods
+    Family &getFamily(const std::string &name, const std::string &help, Kind kind);
+};
+
+#endif
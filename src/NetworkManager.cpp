@@ -1,5 +1,6 @@
 #include <netdb.h>
 #include <cstring>
+#include <cerrno>
 #include "NetworkManager.h"
 #include "Helper.h"
 #include <arpa/inet.h>
@@ -9,11 +10,34 @@
 
 #pragma region Constructor
 
-NetworkManager::NetworkManager(int multicastPort, int peerPort) : multicastPort(multicastPort), peerPort(peerPort),
-                                                                  logger(Logger::getInstance()),
-                                                                  localHostname(getLocalHostname()),
-                                                                  ip(getLocalIPv6()),
-                                                                  crypto(localHostname) {}
+NetworkManager::NetworkManager(int multicastPort, int peerPort, const std::string &keyFile, KeyType keyType) :
+        multicastPort(multicastPort), peerPort(peerPort),
+        logger(Logger::getInstance()),
+        localHostname(getLocalHostname()),
+        ip(getLocalIPv6()),
+        crypto(localHostname, keyFile, keyType),
+        sentMessageCount(Metrics::getInstance().counter("p2p_sent_messages_total", "Messages sent to peers")),
+        sentByteCount(Metrics::getInstance().counter("p2p_sent_bytes_total", "Bytes sent to peers")),
+        receivedMessageCount(Metrics::getInstance().counter("p2p_received_messages_total",
+                                                            "Messages received from peers")),
+        receivedByteCount(Metrics::getInstance().counter("p2p_received_bytes_total", "Bytes received from peers")) {
+    // the main thread only hands the envelopes over, thus there is one worker per core
+    const unsigned int cores = std::thread::hardware_concurrency();
+    if (cores > 1) {
+        cryptoWorkers.reset(new CryptoWorkerPool(crypto, cores, [this](CryptoJob &job) { completeCryptoJob(job); }));
+    }
+
+    Metrics &metrics = Metrics::getInstance();
+    metrics.gauge("p2p_received_queue_depth", "Opened messages that are not processed yet",
+                  [this]() { return (double) receivedMessages.size(); }, this);
+    metrics.gauge("p2p_crypto_pending_jobs", "Envelopes the crypto workers did not finish yet",
+                  [this]() { return cryptoWorkers ? (double) cryptoWorkers->pending() : 0.0; }, this);
+}
+
+NetworkManager::~NetworkManager() {
+    // the gauges read this object
+    Metrics::getInstance().removeGauges(this);
+}
 
 #pragma endregion
 
@@ -70,12 +94,37 @@ void NetworkManager::createMulticastSocket() {
             ".");
 }
 
+/**
+ * Wait in a single poll until a peer, the multicast socket or the input has something to process.
+ * Does not wait while received messages are queued or the crypto workers are busy.
+ * @param inputFd eventfd that is signaled for entered commands
+ * @param timeout in milliseconds, -1 waits without a timeout
+ * @return true if the input is ready
+ */
+bool NetworkManager::waitForEvents(int inputFd, int timeout) {
+    if (!receivedMessages.empty() || (cryptoWorkers && cryptoWorkers->hasPending())) timeout = 0;
+
+    // the connection requests on the first peer socket are accepted elsewhere, thus it is skipped
+    pollfd pollSockets[MAX_NEIGHBORS + 3];
+    int count = 0;
+    for (int i = 1; i < peerSocketsCount; ++i) pollSockets[count++] = {peerPollSockets[i].fd, POLLIN, 0};
+    if (multicastPollSocket != nullptr) pollSockets[count++] = {multicastPollSocket->fd, POLLIN, 0};
+    pollSockets[count++] = {inputFd, POLLIN, 0};
+
+    if (poll(pollSockets, count, timeout) == -1 && errno != EINTR) {
+        logger.log("Failed to poll for events", LogType::ERROR);
+        logger.outputExit(EXIT_FAILURE);
+    }
+    return pollSockets[count - 1].revents & POLLIN;
+}
+
 /**
  * Check the multicast socket for new messages.
+ * @param timeout of the poll in milliseconds
  * @returns received message json or nullptr if nothing received.
  */
-json NetworkManager::processMulticastSocket() {
-    const int pollCount = poll(multicastPollSocket, 1, 1);
+json NetworkManager::processMulticastSocket(int timeout) {
+    const int pollCount = poll(multicastPollSocket, 1, timeout);
     if (pollCount == 0) {
         return nullptr;
     }
@@ -235,7 +284,7 @@ std::string NetworkManager::connectToPeer(const std::string &peerIp, std::string
         return "";
     }
 
-    addToPeerPollSockets(newPeerSocket);
+    if (!addToPeerPollSockets(newPeerSocket)) return "";
 
     // get hostname
     char peerHostname[50];
@@ -245,7 +294,7 @@ std::string NetworkManager::connectToPeer(const std::string &peerIp, std::string
     // reverse lookup hostname of the host
     getnameinfo(res->ai_addr, res->ai_addrlen, peerHostname, sizeof(peerHostname), nullptr, 0, 0);
 
-    hostnameSockets.emplace(peerHostname, newPeerSocket);
+    addConnection(peerHostname, newPeerSocket);
     // save ip and port for a potential reconnect
     ips.add(peerHostname, peerIp);
     hostnamePort.emplace(peerHostname, std::stoi(port));
@@ -263,7 +312,7 @@ bool NetworkManager::acceptPeerConnection(int timeout) {
     bool gotConnection = false;
 
     const auto timeoutTimestamp = std::time(nullptr) + timeout;
-    while (std::time(nullptr) <= timeoutTimestamp && peerSocketsCount < 3) {
+    while (std::time(nullptr) <= timeoutTimestamp && peerSocketsCount <= MAX_NEIGHBORS) {
         // only poll from the first peer socket
         const int pollCount = poll(peerPollSockets, 1, 1);
         if (pollCount == 0) continue;
@@ -285,7 +334,7 @@ bool NetworkManager::acceptPeerConnection(int timeout) {
             logger.outputExit(EXIT_FAILURE);
         }
 
-        addToPeerPollSockets(newPeerSocket);
+        if (!addToPeerPollSockets(newPeerSocket)) continue;
 
         // get IP address
         char peerIP[INET6_ADDRSTRLEN];
@@ -299,7 +348,7 @@ bool NetworkManager::acceptPeerConnection(int timeout) {
         // reverse lookup hostname of the host
         getnameinfo(res->ai_addr, res->ai_addrlen, peerHostname, sizeof(peerHostname), nullptr, 0, 0);
 
-        hostnameSockets.emplace(peerHostname, newPeerSocket);
+        addConnection(peerHostname, newPeerSocket);
         // save ip and port for a potential reconnect
         ips.add(peerHostname, peerIP);
         hostnamePort.emplace(peerHostname, newAddr.sin6_port);
@@ -313,11 +362,17 @@ bool NetworkManager::acceptPeerConnection(int timeout) {
 }
 
 /**
- * Check the peer sockets for new messages.
+ * Check the peer sockets for new messages. The messages of all ready sockets are read at once
+ * and opened by the crypto workers, the opened ones are returned one per call.
+ * @param timeout of the poll in milliseconds
  * @returns received message json or nullptr if nothing received.
  */
-json NetworkManager::processPeerSockets() {
-    const int pollCount = poll(peerPollSockets, peerSocketsCount, 1);
+json NetworkManager::processPeerSockets(int timeout) {
+    if (cryptoWorkers) cryptoWorkers->collect();
+    if (!receivedMessages.empty()) return popReceivedMessage();
+
+    // do not wait for the sockets while the workers are busy
+    const int pollCount = poll(peerPollSockets, peerSocketsCount, cryptoWorkers && cryptoWorkers->hasPending() ? 0 : timeout);
     if (pollCount == 0) return nullptr;
 
     if (pollCount == -1) {
@@ -332,12 +387,22 @@ json NetworkManager::processPeerSockets() {
 
         // Read the incoming message
         std::string message = recvString(currentSocket.fd);
+        const long received = wallMicroseconds();
+        const long receivedAt = nowMicroseconds();
         if (message.empty()) {
+            // the messages of the peer before its disconnect come first
+            if (cryptoWorkers) cryptoWorkers->wait();
+
             auto disconnectedPeer = reverseLookup(currentSocket.fd);
+            // connection was closed on purpose by the other peer
+            if (expectedDisconnects.count(disconnectedPeer)) {
+                disconnectFromPeer(disconnectedPeer);
+                return popReceivedMessage();
+            }
             // Peer disconnected
             logger.log("Lost connection to peer (Hostname: '" + disconnectedPeer + "').");
             removeFromPeerPollSockets(currentSocket.fd);
-            hostnameSockets.erase(disconnectedPeer);
+            removeConnection(disconnectedPeer);
             bool successReconnect;
             int timeout = 1;
             // peer with lower hostname should try the reconnect
@@ -356,7 +421,7 @@ json NetworkManager::processPeerSockets() {
                 while (std::time(nullptr) <= timeoutTimestamp) {}
             }
 
-            if (successReconnect) return nullptr; // do nothing here
+            if (successReconnect) return popReceivedMessage(); // do nothing here
 
             ips.remove(disconnectedPeer);
             hostnamePort.erase(disconnectedPeer);
@@ -364,15 +429,132 @@ json NetworkManager::processPeerSockets() {
             // remove the disconnectedPeer
             json localMessage = buildJson(false, Type::REMOVEPEER, disconnectedPeer);
             localMessage["receivedFrom"] = disconnectedPeer;
-            return localMessage;
+            receivedMessages.push_back({std::move(localMessage), ""});
+            return popReceivedMessage();
+        }
+
+        // the messages of a socket are opened by the same worker, thus they stay in order
+        if (cryptoWorkers) {
+            CryptoJob &job = cryptoWorkers->prepare(currentSocket.fd);
+            job.kind = CryptoJob::Kind::OPEN;
+            job.hostname = reverseLookup(currentSocket.fd);
+            job.socket = currentSocket.fd;
+            job.envelope.swap(message);
+            job.received = received;
+            job.receivedAt = receivedAt;
+            cryptoWorkers->submit();
+            continue;
+        }
+
+        json j;
+        const long start = nowMicroseconds();
+        if (crypto.openPeerMessage(message, decryptedMessage, j)) {
+            // add the hostname of the sending peer
+            j["receivedFrom"] = reverseLookup(currentSocket.fd);
+            pushReceivedMessage(j, message, received, receivedAt, nowMicroseconds() - start);
+        }
+    }
+
+    if (cryptoWorkers) cryptoWorkers->collect();
+    return popReceivedMessage();
+}
+
+/**
+ * Get the oldest opened message.
+ * @return message or nullptr if there is none
+ */
+json NetworkManager::popReceivedMessage() {
+    if (receivedMessages.empty()) return nullptr;
+    ReceivedMessage &received = receivedMessages.front();
+    json message = std::move(received.message);
+    // a group frame is kept until the message is forwarded
+    if (!received.frame.empty()) {
+        receivedFrame.swap(received.frame);
+        receivedFrameId = message["id"];
+    }
+    receivedMessages.pop_front();
+    return message;
+}
+
+/**
+ * Queue an opened message. The received group frame is moved into the queue.
+ * A traced message gets the record of this peer, which is completed when it is forwarded.
+ * Its steady receive time is only kept locally. A trace with MAX_TRACE_HOPS records is dropped.
+ * A link probe or its reply gets the receive time, thus the time spent in the queue is not part of the rtt.
+ * @param message
+ * @param received frame or envelope of the message
+ * @param receivedTime wall time of the receive in microseconds
+ * @param receivedAt steady time of the receive in microseconds
+ * @param cryptoTime duration of the opening in microseconds
+ */
+void NetworkManager::pushReceivedMessage(json &message, std::string &received, long receivedTime, long receivedAt,
+                                         long cryptoTime) {
+    auto hops = message.find("hops");
+    if (hops != message.end() && (!hops->is_array() || hops->size() >= MAX_TRACE_HOPS)) {
+        message.erase(hops);
+        // the group frame is forwarded without its records
+        if (!received.empty() && (unsigned char) received[0] == TRACED_FRAME_VERSION) {
+            const auto *data = reinterpret_cast<const unsigned char *>(received.data());
+            received.erase(0, 3 + (data[1] << 8 | data[2]));
         }
+    } else if (hops != message.end()) {
+        hops->push_back({localHostname, receivedTime, cryptoTime, receivedAt});
+    }
+    const int type = message.value("type", -1);
+    if (type == static_cast<int>(Type::LINKPROBE) || type == static_cast<int>(Type::LINKREPLY)) {
+        message["receivedAt"] = receivedAt;
+    }
+
+    receivedMessages.push_back({std::move(message), ""});
+    if (!received.empty() && ((unsigned char) received[0] == GROUP_FRAME_VERSION ||
+                              (unsigned char) received[0] == TRACED_FRAME_VERSION)) {
+        receivedMessages.back().frame.swap(received);
+    }
+}
+
+/**
+ * Handle a job of the crypto workers: queue the opened message or send the sealed one.
+ * @param job
+ */
+void NetworkManager::completeCryptoJob(CryptoJob &job) {
+    if (job.kind == CryptoJob::Kind::OPEN) {
+        if (job.message != nullptr) pushReceivedMessage(job.message, job.envelope, job.received, job.receivedAt, job.cryptoTime);
+        job.message = nullptr;
+        return;
+    }
 
-        json j = tryParse(crypto.privateDecrypt(message));
-        // add the hostname of the sending peer
-        if (j != nullptr) j["receivedFrom"] = reverseLookup(currentSocket.fd);
-        return j;
+    // like the inline path, a failed seal skips the hop without marking it
+    if (!job.success) {
+        logger.log("Failed to encrypt the command for peer '" + job.hostname + "'.", LogType::ERROR);
+        return;
+    }
+    if (!sendString(job.socket, job.envelope)) {
+        logger.log("Error while sending command to another peer.", LogType::ERROR);
+        failedSeals.insert(job.hostname);
     }
-    return nullptr;
+}
+
+/**
+ * Mark the connection to a peer as closed on purpose. If the other peer closes it, no reconnect is done.
+ * @param hostname of the peer
+ */
+void NetworkManager::expectDisconnect(const std::string &hostname) {
+    expectedDisconnects.insert(hostname);
+}
+
+/**
+ * Close the connection to a peer without triggering a reconnect.
+ * @param hostname of the peer
+ */
+void NetworkManager::disconnectFromPeer(const std::string &hostname) {
+    expectedDisconnects.erase(hostname);
+    auto socket = getSocket(hostname);
+    if (socket == -1) return;
+
+    removeFromPeerPollSockets(socket);
+    removeConnection(hostname);
+    close(socket);
+    logger.trace(TraceFormat::CLOSED_CONNECTION, hostname);
 }
 
 /**
@@ -391,11 +573,18 @@ void NetworkManager::closeAllSockets() {
 /**
  * Add the socket to the peer poll sockets.
  * @param socket id of the new socket
+ * @return false if there is no place left and the socket was closed
  */
-void NetworkManager::addToPeerPollSockets(int socket) {
+bool NetworkManager::addToPeerPollSockets(int socket) {
+    if (peerSocketsCount >= (int) (sizeof(peerPollSockets) / sizeof(pollfd))) {
+        logger.log("Too many peer connections. Closing the new one.", LogType::ERROR);
+        close(socket);
+        return false;
+    }
     peerPollSockets[peerSocketsCount].fd = socket;
     peerPollSockets[peerSocketsCount].events = POLLIN;
     peerSocketsCount++;
+    return true;
 }
 
 /**
@@ -427,9 +616,10 @@ void NetworkManager::removeFromPeerPollSockets(int socket) {
  * @param type Type of the request
  * @param payload
  * @param nextHops set of hostnames the command should be send to
+ * @param hops records of a traced message, an empty array starts a trace, nullptr: not traced
  */
-json
-NetworkManager::sendCommand(const Type type, const json &payload, const std::set<std::string> &nextHops) {
+json NetworkManager::sendCommand(const Type type, const json &payload, const std::set<std::string> &nextHops,
+                                 const json &hops) {
     // get proposal confirmation for this types
     if (type == Type::CONFIRMATION || type == Type::REJECT || type == Type::NICK || type == Type::LEAVE ||
         type == Type::JOIN || type == Type::CREATE) {
@@ -438,24 +628,176 @@ NetworkManager::sendCommand(const Type type, const json &payload, const std::set
         return message;
     } else {
         // send command to sockets
-        forwardMessage(buildJson(false, type, payload), nextHops);
+        json message = buildJson(false, type, payload);
+        if (hops.is_array()) message["hops"] = hops;
+        forwardMessage(message, nextHops);
         return nullptr;
     }
 }
 
 /**
- * Send a message to next hops
+ * Send a message to next hops. A traced message gets the completed record of this peer.
+ * Next hops that fail are no longer returned as neighbors, until they reconnect or get removed.
  * @param message
  * @param nextHops set of hostnames the message should be send to
+ * @param exclude hostname of a next hop to skip
+ * @return set of next hops the message could not be sent to
  */
-void NetworkManager::forwardMessage(const json &message, const std::set<std::string> &nextHops) {
+std::set<std::string> NetworkManager::forwardMessage(const json &message, const std::set<std::string> &nextHops,
+                                                     const std::string &exclude) {
+    auto hops = message.find("hops");
+    if (hops == message.end() || !hops->is_array()) return sendMessage(message, nextHops, exclude);
+
+    // the record is added to a copy, thus retries over other next hops complete the record again
+    json traced = message;
+    completeHop(traced["hops"]);
+    return sendMessage(traced, nextHops, exclude);
+}
+
+/**
+ * Complete the record of this peer in the hops of a traced message, right before it is sent:
+ * [hostname, received, crypto, queue, sent] in microseconds. Received and sent are wall times to compare
+ * them between peers, the durations are taken from the steady clock.
+ * The local record [hostname, received, crypto, steady received] is replaced. The record of the origin starts now.
+ * @param hops records of the former hops
+ */
+void NetworkManager::completeHop(json &hops) const {
+    const long now = wallMicroseconds();
+    const long steadyNow = nowMicroseconds();
+    const bool started = !hops.empty() && hops.back().is_array() && hops.back().size() == 4 &&
+                         hops.back()[0] == localHostname && hops.back()[1].is_number() &&
+                         hops.back()[2].is_number() && hops.back()[3].is_number();
+    if (!started) {
+        hops.push_back({localHostname, now, 0, steadyNow});
+    }
+    json &hop = hops.back();
+    const long queue = steadyNow - hop[3].get<long>() - hop[2].get<long>();
+    hop[3] = queue;
+    hop.push_back(now);
+}
+
+/**
+ * Seal a message for every next hop and send it. Group messages are sent in their received frame.
+ * @param message
+ * @param nextHops set of hostnames the message should be send to
+ * @param exclude hostname of a next hop to skip
+ * @return set of next hops the message could not be sent to
+ */
+std::set<std::string> NetworkManager::sendMessage(const json &message, const std::set<std::string> &nextHops,
+                                                  const std::string &exclude) {
+    // group messages are forwarded in their signed frame, without any crypto
+    if (!receivedFrame.empty() && message["id"] == receivedFrameId) {
+        // the records of a traced frame are replaced, the signed frame stays unchanged
+        auto hops = message.find("hops");
+        if (hops != message.end() && CryptoManager::traceGroupFrame(*hops, receivedFrame, encryptedMessage)) {
+            return sendFrame(encryptedMessage, nextHops, exclude);
+        }
+        return sendFrame(receivedFrame, nextHops, exclude);
+    }
+
+    std::set<std::string> failedHops;
     const auto rq = message.dump();
-    for (auto nextHop : nextHops) {
-        auto socket = getSocket(nextHop);
-        if (!sendString(socket, crypto.publicEncrypt(rq, nextHop))) {
+    // the next hops are sealed in parallel, a single one is not worth the handover
+    if (cryptoWorkers && nextHops.size() > 1) {
+        failedSeals.clear();
+        for (const auto &nextHop : nextHops) {
+            if (nextHop == exclude) continue;
+            CryptoJob &job = cryptoWorkers->prepare(hashString(nextHop));
+            job.kind = CryptoJob::Kind::SEAL;
+            job.hostname = nextHop;
+            job.socket = getSocket(nextHop);
+            job.plaintext = &rq;
+            cryptoWorkers->submit();
+        }
+        // the sealed messages are sent while they are collected
+        cryptoWorkers->wait();
+        failedHops.swap(failedSeals);
+    } else {
+        for (const auto &nextHop : nextHops) {
+            if (nextHop == exclude) continue;
+            // a missing key is no broken link, thus the hop is only skipped
+            if (!crypto.publicEncrypt(rq, nextHop, encryptedMessage)) {
+                logger.log("Failed to encrypt the command for peer '" + nextHop + "'.", LogType::ERROR);
+                continue;
+            }
+            if (!sendString(getSocket(nextHop), encryptedMessage)) {
+                logger.log("Error while sending command to another peer.", LogType::ERROR);
+                failedHops.insert(nextHop);
+            }
+        }
+    }
+    markFailedHops(failedHops);
+    return failedHops;
+}
+
+/**
+ * Send a message to the members of a group. The text is encrypted once with the group key
+ * and all next hops get the same signed frame.
+ * @param groupName
+ * @param text plaintext of the message
+ * @param nextHops set of hostnames the message should be send to
+ * @param trace true: the hops add their records to the frame
+ * @return set of next hops the message could not be sent to
+ */
+std::set<std::string> NetworkManager::sendGroupMessage(const std::string &groupName, const std::string &text,
+                                                       const std::set<std::string> &nextHops, bool trace) {
+    const long start = wallMicroseconds();
+    const long steadyStart = nowMicroseconds();
+    const std::string header = buildJson(false, Type::MSG, {{"target", groupName}}).dump();
+    if (!crypto.sealGroupFrame(header, text, groupName, encryptedMessage)) {
+        logger.log("Failed to encrypt the message for group '" + groupName + "'.", LogType::ERROR);
+        return nextHops;
+    }
+    if (!trace) return sendFrame(encryptedMessage, nextHops, "");
+
+    // the records are not signed, thus the sealing of the origin is part of its record
+    json hops = json::array({{localHostname, start, nowMicroseconds() - steadyStart, steadyStart}});
+    completeHop(hops);
+    std::string traced;
+    if (!CryptoManager::traceGroupFrame(hops, encryptedMessage, traced)) return nextHops;
+    return sendFrame(traced, nextHops, "");
+}
+
+/**
+ * Send a frame unchanged to next hops.
+ * @param frame
+ * @param nextHops set of hostnames the frame should be send to
+ * @param exclude hostname of a next hop to skip
+ * @return set of next hops the frame could not be sent to
+ */
+std::set<std::string> NetworkManager::sendFrame(const std::string &frame, const std::set<std::string> &nextHops,
+                                                const std::string &exclude) {
+    std::set<std::string> failedHops;
+    for (const auto &nextHop : nextHops) {
+        if (nextHop == exclude) continue;
+        if (!sendString(getSocket(nextHop), frame)) {
             logger.log("Error while sending command to another peer.", LogType::ERROR);
+            failedHops.insert(nextHop);
         }
     }
+    markFailedHops(failedHops);
+    return failedHops;
+}
+
+/**
+ * Next hops that failed are no longer returned as neighbors, until they reconnect or get removed.
+ * @param failedHops
+ */
+void NetworkManager::markFailedHops(const std::set<std::string> &failedHops) {
+    // nextHops can be the neighbors, thus they are changed after sending
+    for (const auto &failedHop : failedHops) {
+        failedNeighbors.insert(failedHop);
+        neighbors.erase(failedHop);
+    }
+}
+
+/**
+ * Send a message to all neighbors, except the one it came from.
+ * @param message
+ * @param receivedFrom hostname of the peer the message came from
+ */
+void NetworkManager::broadcastMessage(const json &message, const std::string &receivedFrom) {
+    forwardMessage(message, neighbors, receivedFrom);
 }
 
 #pragma endregion
@@ -522,7 +864,7 @@ std::string NetworkManager::getLocalIPv6() {
  * @param hostname
  * @return socket or -1 if invalid hostname
  */
-int NetworkManager::getSocket(std::string &hostname) const {
+int NetworkManager::getSocket(const std::string &hostname) const {
     auto iterator = hostnameSockets.find(hostname);
 
     if (iterator == hostnameSockets.end()) return -1;
@@ -530,29 +872,60 @@ int NetworkManager::getSocket(std::string &hostname) const {
 }
 
 /**
- * Get the connected neighbors of this peer.
- * @return Set of hostnames
+ * Add a connection to the connection tables and neighbors.
+ * @param hostname of the peer
+ * @param socket of the connection
  */
-std::set<std::string> NetworkManager::getNeighbors() {
-    std::set<std::string> neighbors;
-    for (auto i = 1; i < peerSocketsCount; ++i) {
-        auto neighborHostname = reverseLookup(peerPollSockets[i].fd);
-        if (!neighborHostname.empty()) neighbors.insert(neighborHostname);
+void NetworkManager::addConnection(const std::string &hostname, int socket) {
+    hostnameSockets.emplace(hostname, socket);
+    socketHostnames.emplace(socket, hostname);
+    failedNeighbors.erase(hostname);
+    neighbors.insert(hostname);
+
+    Metrics &metrics = Metrics::getInstance();
+    const std::string labels = "peer=\"" + hostname + "\"";
+    socketCounters[socket] = {&metrics.counter("p2p_link_sent_bytes_total", "Bytes sent on a connection", labels),
+                              &metrics.counter("p2p_link_received_bytes_total", "Bytes received on a connection",
+                                               labels)};
+}
+
+/**
+ * Remove a connection from the connection tables and neighbors. The socket is not closed.
+ * The counters of the connection are removed, unless another connection to the peer still uses them.
+ * @param hostname of the peer
+ */
+void NetworkManager::removeConnection(const std::string &hostname) {
+    auto iterator = hostnameSockets.find(hostname);
+    if (iterator != hostnameSockets.end()) {
+        socketHostnames.erase(iterator->second);
+        auto counters = socketCounters.find(iterator->second);
+        if (counters != socketCounters.end()) {
+            const Counter *sentBytes = counters->second.sentBytes;
+            socketCounters.erase(counters);
+            bool used = false;
+            for (const auto &item : socketCounters) used |= item.second.sentBytes == sentBytes;
+            if (!used) {
+                Metrics &metrics = Metrics::getInstance();
+                const std::string labels = "peer=\"" + hostname + "\"";
+                metrics.removeCounter("p2p_link_sent_bytes_total", labels);
+                metrics.removeCounter("p2p_link_received_bytes_total", labels);
+            }
+        }
+        hostnameSockets.erase(iterator);
     }
-    return neighbors;
+    failedNeighbors.erase(hostname);
+    neighbors.erase(hostname);
 }
 
 /**
  * Return the hostname for a socket.
  * @return hostname or empty string if unknown
  */
-std::string NetworkManager::reverseLookup(int socket) {
-    for (const auto &pair : hostnameSockets) {
-        if (pair.second == socket) {
-            return pair.first;
-        }
-    }
-    return "";
+std::string NetworkManager::reverseLookup(int socket) const {
+    auto iterator = socketHostnames.find(socket);
+
+    if (iterator == socketHostnames.end()) return "";
+    return iterator->second;
 }
 
 /**
@@ -577,9 +950,11 @@ json NetworkManager::buildJson(bool proposal, Type type, const json &payload) {
 #pragma region Send & Receive
 
 size_t NetworkManager::sendAll(int socket, void const *buff, size_t buffLen) {
-    size_t result, total = 0;
+    ssize_t result;
+    size_t total = 0;
     while (total < buffLen) {
-        result = ::send(socket, (void *) buff, buffLen, 0);
+        // a closed connection should fail the send instead of raising SIGPIPE
+        result = ::send(socket, (void *) buff, buffLen - total, MSG_NOSIGNAL);
         if (result < 0)
             return -1;
         else if (result == 0)
@@ -613,13 +988,21 @@ bool NetworkManager::sendString(int socket, const std::string &message) {
         success = false;
     }
 
+    if (success) {
+        sentMessageCount.add();
+        sentByteCount.add(sizeof len + message.size());
+        auto iterator = socketCounters.find(socket);
+        if (iterator != socketCounters.end()) iterator->second.sentBytes->add(sizeof len + message.size());
+    }
     return success;
 }
 
 size_t NetworkManager::recvAll(int socket, void *buff, size_t buffLen) {
-    size_t result, total = 0;
+    ssize_t result;
+    size_t total = 0;
     while (total < buffLen) {
-        result = ::recv(socket, (void *) buff, buffLen, 0);
+        // binary envelopes can arrive in several parts
+        result = ::recv(socket, (void *) buff, buffLen - total, 0);
         if (result < 0) {
             return -1;
         } else if (result == 0) {
@@ -650,6 +1033,11 @@ std::string NetworkManager::recvString(int socket) {
         return "";
     }
 
+    receivedMessageCount.add();
+    receivedByteCount.add(sizeof len + len);
+    auto iterator = socketCounters.find(socket);
+    if (iterator != socketCounters.end()) iterator->second.receivedBytes->add(sizeof len + len);
+
     // Return received string
     return msg;
 }
@@ -5,14 +5,23 @@
 #include "Logger.h"
 #include "IpManager.h"
 #include "CryptoManager.h"
+#include "CryptoWorkerPool.h"
+#include "Topology.h"
+#include "Metrics.h"
 #include <nlohmann/json.hpp>
 #include <set>
+#include <deque>
+#include <memory>
+
+#define MAX_TRACE_HOPS 64 // records of a traced message, longer traces are dropped
 
 using json = nlohmann::json;
 
 class NetworkManager {
 public:
-    explicit NetworkManager(int multicastPort, int peerPort);
+    explicit NetworkManager(int multicastPort, int peerPort, const std::string &keyFile = "",
+                            KeyType keyType = KeyType::RSA);
+    ~NetworkManager();
 
     // getter
     const std::string &getHostname() const { return localHostname; }
@@ -20,23 +29,33 @@ public:
 
     // methods
     void createMulticastSocket();
-    json processMulticastSocket();
-    json processPeerSockets();
+    bool waitForEvents(int inputFd, int timeout);
+    json processMulticastSocket(int timeout = 1);
+    json processPeerSockets(int timeout = 1);
     std::string connectToPeer(const std::string &peerIp, std::string port = "");
     void createPeerPollSocket();
     void sendDiscoveryMessage() const;
-    json sendCommand(Type type, const json &payload, const std::set<std::string> &nextHops);
-    void forwardMessage(const json &message, const std::set<std::string> &nextHops);
+    json sendCommand(Type type, const json &payload, const std::set<std::string> &nextHops,
+                     const json &hops = nullptr);
+    std::set<std::string> forwardMessage(const json &message, const std::set<std::string> &nextHops,
+                                         const std::string &exclude = "");
+    std::set<std::string> sendGroupMessage(const std::string &groupName, const std::string &text,
+                                           const std::set<std::string> &nextHops, bool trace = false);
+    void broadcastMessage(const json &message, const std::string &receivedFrom);
     bool acceptPeerConnection(int timeout = 2);
+    void expectDisconnect(const std::string &hostname);
+    void disconnectFromPeer(const std::string &hostname);
     void closeAllSockets();
-    std::set<std::string> getNeighbors();
+    const std::set<std::string> &getNeighbors() const { return neighbors; }
 
     // Crypto Wrapper functions
     std::string groupEncrypt(const std::string &plaintext, const std::string &groupName) { return crypto.groupEncrypt(plaintext, groupName); }
     std::string groupDecrypt(const std::string &encryptedText, const std::string &groupName) { return crypto.groupDecrypt(encryptedText, groupName); }
     std::string publicEncrypt(const std::string &plaintext, const std::string &target) { return crypto.publicEncrypt(plaintext, target); }
     std::string privateDecrypt(const std::string &encyptedText) { return crypto.privateDecrypt(encyptedText); };
+    KeyType getKeyType() const { return crypto.getKeyType(); }
     bool addPublicKey(const std::string &hostname, const std::string &publicKey) { return crypto.add(hostname, publicKey); }
+    bool removePublicKey(const std::string &hostname) { return crypto.remove(hostname); }
     std::string getPublicKey(const std::string &hostname) { return crypto.get(hostname); }
     const std::string &getPrivateKey() const { return crypto.getPrivateKey(); };
     bool setGroupKey(const std::string &groupName, const std::string &key) { return crypto.setGroupKey(groupName, key); }
@@ -50,29 +69,67 @@ private:
     uint16_t peerPort;
     Logger &logger;
     pollfd *multicastPollSocket{};
-    pollfd peerPollSockets[4]{}; // place for the poll socket and 3 connections
+    pollfd peerPollSockets[MAX_NEIGHBORS + 2]{}; // place for the poll socket, the connections and one during a handover
     int peerSocketsCount = 0;
     std::map<std::string, int> hostnameSockets;
+    std::map<int, std::string> socketHostnames; // connected peers by socket
+    std::set<std::string> neighbors; // connected peers without the failed ones, only changed on (dis)connects
+    std::set<std::string> expectedDisconnects; // peers whose connection gets closed on purpose
+    std::set<std::string> failedNeighbors; // neighbors a message could not be sent to
     IpManager ips;
     std::map<std::string, int> hostnamePort;
     std::string localHostname;
     std::string ip;
     int messageId = 0;
     CryptoManager crypto;
+    std::string encryptedMessage; // reused for every sent message to keep its capacity
+    std::string decryptedMessage; // reused for every received message to keep its capacity
+    std::unique_ptr<CryptoWorkerPool> cryptoWorkers; // nullptr on a single core, then the main thread does the crypto
+    // opened message with its group frame, which is empty for other messages
+    struct ReceivedMessage {
+        json message;
+        std::string frame;
+    };
+    std::deque<ReceivedMessage> receivedMessages; // opened messages, that are not returned yet
+    std::string receivedFrame; // group frame of the last returned message, forwarded unchanged
+    std::string receivedFrameId; // id of the last returned message with a group frame
+    std::set<std::string> failedSeals; // next hops the sealed envelopes of the workers could not be sent to
+    // traffic of a connection
+    struct LinkCounters {
+        Counter *sentBytes;
+        Counter *receivedBytes;
+    };
+    std::map<int, LinkCounters> socketCounters; // by socket
+    Counter &sentMessageCount;
+    Counter &sentByteCount;
+    Counter &receivedMessageCount;
+    Counter &receivedByteCount;
 
     // methods
     json buildJson(bool proposal, Type type, const json &payload);
-    void addToPeerPollSockets(int socket);
+    bool addToPeerPollSockets(int socket);
     void removeFromPeerPollSockets(int socket);
-    std::string reverseLookup(int socket);
+    void addConnection(const std::string &hostname, int socket);
+    void removeConnection(const std::string &hostname);
+    std::string reverseLookup(int socket) const;
     std::string getLocalHostname();
     std::string getLocalIPv6();
-    int getSocket(std::string &hostname) const;
+    int getSocket(const std::string &hostname) const;
+    void completeCryptoJob(CryptoJob &job);
+    json popReceivedMessage();
+    void pushReceivedMessage(json &message, std::string &received, long receivedTime, long receivedAt,
+                             long cryptoTime);
+    std::set<std::string> sendMessage(const json &message, const std::set<std::string> &nextHops,
+                                      const std::string &exclude);
+    void completeHop(json &hops) const;
+    std::set<std::string> sendFrame(const std::string &frame, const std::set<std::string> &nextHops,
+                                    const std::string &exclude);
+    void markFailedHops(const std::set<std::string> &failedHops);
+    bool sendString(int socket, const std::string &message);
+    std::string recvString(int socket);
 
     //statics
-    static bool sendString(int socket, const std::string &message);
     static size_t sendAll(int socket, void const *buff, size_t buffLen);
-    static std::string recvString(int socket);
     static size_t recvAll(int socket, void *buff, size_t buffLen);
 };
 
@@ -1,4 +1,3 @@
-#include <regex>
 #include <unistd.h>
 #include "NicknameManager.h"
 
@@ -94,9 +93,11 @@ json NicknameManager::toJson() {
  * @return boolean
  */
 bool NicknameManager::checkNickname(const std::string &nickname) {
-    std::regex nickRegex;
-    nickRegex.assign(R"(^[A-Za-z0-9]{1,9}$)");
-    return regex_match(nickname, nickRegex);
+    if (nickname.empty() || nickname.size() > 9) return false;
+    for (const char c : nickname) {
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) return false;
+    }
+    return true;
 }
 
 /**
@@ -1,5 +1,9 @@
 #include <netdb.h>
+#include <random>
+#include <algorithm>
 #include "Topology.h"
+#include "Helper.h"
+#include "Metrics.h"
 #include <graphviz/gvc.h>
 
 #pragma region Constructor
@@ -17,10 +21,14 @@ Topology::Topology(const std::string &centerPeer) : centerPeer(centerPeer) {
 void Topology::addPeer(const std::string &hostname) {
     Peer newPeer;
     newPeer.hostname = hostname;
-    peers.push_back(newPeer);
+    if (peers.emplace(hostname, newPeer).second) {
+        degreeIndex.emplace(0, hostname);
+        hostnames.insert(std::lower_bound(hostnames.begin(), hostnames.end(), hostname), hostname);
+    }
 
     // trigger next hop calculation on change
-    calculateNextHops();
+    routesOutdated = true;
+    ++version;
 }
 
 /**
@@ -28,24 +36,29 @@ void Topology::addPeer(const std::string &hostname) {
  * @param hostname Hostname of the peer
  */
 void Topology::removePeer(const std::string &hostname) {
-    auto currentPeerIt = std::find_if(peers.begin(), peers.end(),
-                                      [&hostname](const Peer &peer) { return peer.hostname == hostname; });
+    auto currentPeerIt = peers.find(hostname);
     if (currentPeerIt == peers.end()) return;
-    auto currentPeer = currentPeerIt.base();
+    auto currentPeer = &currentPeerIt->second;
 
     // remove peer from neighbors
     for (const auto &neighbor: currentPeer->neighbors) {
-        auto currentNeighbor = getPeer(neighbor);
+        auto currentNeighbor = findPeer(neighbor);
         if (currentNeighbor == nullptr) continue;
 
+        degreeIndex.erase({currentNeighbor->neighbors.size(), neighbor});
         currentNeighbor->neighbors.erase(currentPeer->hostname);
+        currentNeighbor->linkWeights.erase(currentPeer->hostname);
+        degreeIndex.emplace(currentNeighbor->neighbors.size(), neighbor);
     }
 
     // remove peer from peers
+    degreeIndex.erase({currentPeer->neighbors.size(), hostname});
+    hostnames.erase(std::lower_bound(hostnames.begin(), hostnames.end(), hostname));
     peers.erase(currentPeerIt);
 
     // trigger next hop calculation on change
-    calculateNextHops();
+    routesOutdated = true;
+    ++version;
 }
 
 /**
@@ -55,32 +68,127 @@ void Topology::removePeer(const std::string &hostname) {
  * @param connected
  */
 void Topology::setConnection(const std::string &hostname1, const std::string &hostname2, bool connected) {
-    auto peer1 = getPeer(hostname1);
-    auto peer2 = getPeer(hostname2);
+    auto peer1 = findPeer(hostname1);
+    auto peer2 = findPeer(hostname2);
     if (peer1 == nullptr || peer2 == nullptr) return;
 
+    degreeIndex.erase({peer1->neighbors.size(), hostname1});
+    degreeIndex.erase({peer2->neighbors.size(), hostname2});
     if (connected) {
         peer1->neighbors.insert(hostname2);
         peer2->neighbors.insert(hostname1);
     } else {
         peer1->neighbors.erase(hostname2);
         peer2->neighbors.erase(hostname1);
+        peer1->linkWeights.erase(hostname2);
+        peer2->linkWeights.erase(hostname1);
     }
+    degreeIndex.emplace(peer1->neighbors.size(), hostname1);
+    degreeIndex.emplace(peer2->neighbors.size(), hostname2);
 
     // trigger next hop calculation on change
-    calculateNextHops();
+    routesOutdated = true;
+    ++version;
+}
+
+/**
+ * Set the latency of a connection measured by a peer.
+ * @param hostname Peer that measured the latency
+ * @param neighbor Other end of the connection
+ * @param weight latency in microseconds
+ * @return true if the weight changed
+ */
+bool Topology::setLinkWeight(const std::string &hostname, const std::string &neighbor, int weight) {
+    auto peer = findPeer(hostname);
+    if (peer == nullptr || peer->neighbors.find(neighbor) == peer->neighbors.end()) return false;
+    if (weight < 1) weight = 1;
+
+    auto &linkWeight = peer->linkWeights[neighbor];
+    if (linkWeight == weight) return false;
+    linkWeight = weight;
+
+    // trigger next hop calculation on change
+    routesOutdated = true;
+    ++version;
+    return true;
 }
 
 /**
- * Get a pointer to a peer. This pointer should not be stored, because it can get invalid!
+ * Get the weight of a connection in the direction from hostname to neighbor.
+ * Prefers the latency measured by hostname, falls back to the one measured by neighbor.
+ * @param hostname
+ * @param neighbor
+ * @return latency in microseconds or DEFAULT_LINK_WEIGHT if nothing was measured
+ */
+int Topology::getLinkWeight(const std::string &hostname, const std::string &neighbor) {
+    auto peer = findPeer(hostname);
+    if (peer == nullptr) return DEFAULT_LINK_WEIGHT;
+    auto linkWeight = peer->linkWeights.find(neighbor);
+    if (linkWeight != peer->linkWeights.end()) return linkWeight->second;
+
+    auto neighborPeer = findPeer(neighbor);
+    if (neighborPeer == nullptr) return DEFAULT_LINK_WEIGHT;
+    linkWeight = neighborPeer->linkWeights.find(hostname);
+    if (linkWeight != neighborPeer->linkWeights.end()) return linkWeight->second;
+    return DEFAULT_LINK_WEIGHT;
+}
+
+/**
+ * Get a pointer to a peer with up to date routing information.
+ * This pointer should not be stored, because it can get invalid!
  * @param hostname of the peer
  * @return Pointer to the peer of nullptr if not found.
  */
 Topology::Peer *Topology::getPeer(const std::string &hostname) {
-    auto currentPeerIt = std::find_if(peers.begin(), peers.end(),
-                                      [&hostname](const Peer &peer) { return peer.hostname == hostname; });
+    updateRoutes();
+    return findPeer(hostname);
+}
+
+/**
+ * Get the next hop for a flow to a peer. Flows are spread over the paths that share the load.
+ * If the next hop of the flow is not available, the cheapest available alternative is taken.
+ * @param hostname of the target peer
+ * @param flow identification of the flow, e.g. origin and target
+ * @param availableHops next hops that can be used, e.g. the connected neighbors
+ * @return hostname of the next hop or empty string if the peer is unreachable
+ */
+std::string Topology::getNextHop(const std::string &hostname, const std::string &flow,
+                                 const std::set<std::string> &availableHops) {
+    auto peer = getPeer(hostname);
+    if (peer == nullptr || peer->nextHops.empty()) return "";
+
+    if (peer->multipathCount > 0) {
+        const auto &flowHop = peer->nextHops.at(hashString(flow) % peer->multipathCount);
+        if (availableHops.find(flowHop) != availableHops.end()) return flowHop;
+    }
+
+    // fail over to the next alternative
+    for (const auto &nextHop : peer->nextHops) {
+        if (availableHops.find(nextHop) != availableHops.end()) return nextHop;
+    }
+    return "";
+}
+
+/**
+ * Get the neighbors of a peer without updating the routing information.
+ * @param hostname of the peer
+ * @return set of hostnames or empty set if peer is unknown
+ */
+std::set<std::string> Topology::getNeighbors(const std::string &hostname) {
+    auto peer = findPeer(hostname);
+    if (peer == nullptr) return std::set<std::string>();
+    return peer->neighbors;
+}
+
+/**
+ * Get a pointer to a peer without updating the routing information.
+ * @param hostname of the peer
+ * @return Pointer to the peer of nullptr if not found.
+ */
+Topology::Peer *Topology::findPeer(const std::string &hostname) {
+    auto currentPeerIt = peers.find(hostname);
     if (currentPeerIt == peers.end()) return nullptr;
-    return currentPeerIt.base();
+    return &currentPeerIt->second;
 }
 
 /**
@@ -100,13 +208,15 @@ void Topology::plot() {
 
     std::map<std::string, Agnode_s *> nodes;
     // add all nodes
-    for (const auto &peer: peers) {
+    for (const auto &item: peers) {
+        const auto &peer = item.second;
         nodes.emplace(peer.hostname, agnode(g, (char *) peer.hostname.c_str(), 1));
     }
 
     // add edges
     std::set<std::string> processed;
-    for (const auto &peer: peers) {
+    for (const auto &item: peers) {
+        const auto &peer = item.second;
         processed.insert(peer.hostname);
         for (const auto &neighbor: peer.neighbors) {
             if (processed.find(neighbor) != processed.end()) continue;
@@ -141,10 +251,10 @@ std::vector<std::string> Topology::getShortestPath(const std::string &hostname)
 
     // if peer is not the center or a neighbor of the center
     if (!peer->previous.empty() && peer->previous != centerPeer) {
-        auto previous = getPeer(peer->previous);
+        auto previous = findPeer(peer->previous);
         while (previous != nullptr && previous->hostname != centerPeer) {
             path.push_back(previous->hostname);
-            previous = getPeer(previous->previous);
+            previous = findPeer(previous->previous);
         }
     }
 
@@ -158,9 +268,10 @@ std::vector<std::string> Topology::getShortestPath(const std::string &hostname)
 }
 
 std::map<std::string, std::string> Topology::getRoutingTable() {
+    updateRoutes();
     std::map<std::string, std::string> routingTable;
-    for (auto const &peer : peers) {
-        routingTable.emplace(peer.hostname, peer.nextHop);
+    for (auto const &item : peers) {
+        routingTable.emplace(item.first, item.second.nextHop);
     }
     return routingTable;
 }
@@ -172,10 +283,13 @@ std::map<std::string, std::string> Topology::getRoutingTable() {
 void Topology::loadJson(const json &j) {
     // clear the peers and re-add the center
     peers.clear();
+    degreeIndex.clear();
+    hostnames.clear();
     addPeer(centerPeer);
 
     // neighbor pairs
     std::vector<std::array<std::string, 2>> connections;
+    std::map<std::string, std::map<std::string, int>> linkWeights;
     for (auto &item : j.items()) {
         std::string hostname = item.value().value("hostname", "");
         std::vector<std::string> neighbors = item.value().value("neighbors", std::vector<std::string>());
@@ -185,11 +299,17 @@ void Topology::loadJson(const json &j) {
         for (const auto &neighbor: neighbors) {
             connections.push_back({hostname, neighbor});
         }
+        linkWeights.emplace(hostname, item.value().value("linkWeights", std::map<std::string, int>()));
     }
 
     for (const auto &connection: connections) {
         setConnection(connection[0], connection[1], true);
     }
+    for (const auto &peerWeights: linkWeights) {
+        for (const auto &linkWeight: peerWeights.second) {
+            setLinkWeight(peerWeights.first, linkWeight.first, linkWeight.second);
+        }
+    }
 }
 
 /**
@@ -198,162 +318,352 @@ void Topology::loadJson(const json &j) {
  */
 json Topology::toJson() {
     json j;
-    for (const auto &peer: peers) {
-        j.push_back({{"hostname",  peer.hostname},
-                     {"neighbors", peer.neighbors}});
+    for (const auto &item: peers) {
+        const auto &peer = item.second;
+        j.push_back({{"hostname",    peer.hostname},
+                     {"neighbors",   peer.neighbors},
+                     {"linkWeights", peer.linkWeights}});
     }
     return j;
 }
 
 /**
- * Calculate next hops for all peers.
+ * Recalculate the next hops if the topology changed since the last calculation.
+ */
+void Topology::updateRoutes() {
+    if (!routesOutdated) return;
+    static Histogram &routingTime = Metrics::getInstance().histogram("p2p_routing_update",
+                                                                     "Recalculation of the routes");
+    ScopedTimer timer(routingTime);
+    calculateNextHops();
+    calculateAlternativeNextHops();
+    routesOutdated = false;
+}
+
+/**
+ * Calculate next hops for all peers. Connections are weighted with their measured latency.
  * To send a message to a peer, send the message to peer.nextHop.
  * peer.nextHop contains the hostname of the peer that is directly connected to the center peer.
  * If a peer is unreachable, the nextHop and previous will be empty.
- * @param start The hostname of the start peer
  */
 void Topology::calculateNextHops() {
-    std::set<std::string> Q;
+    // queue ordered by distance and hostname
+    std::set<std::pair<int, std::string>> Q;
     // reset
-    for (auto &peer: peers) {
+    for (auto &item: peers) {
+        auto &peer = item.second;
         peer.distance = peer.hostname == centerPeer ? 0 : INT32_MAX - 1;
         peer.previous = "";
-        Q.insert(peer.hostname);
+        peer.nextHop = "";
     }
 
+    auto center = findPeer(centerPeer);
+    if (center == nullptr) return;
+    Q.emplace(0, centerPeer);
+
     while (!Q.empty()) {
         // Peer in Q with minimum distance
-        Peer *u;
-        int minDistance = INT32_MAX - 1;
-        for (const auto &hostname : Q) {
-            auto peer = getPeer(hostname);
-            if (peer->distance <= minDistance) {
-                u = peer;
-                minDistance = peer->distance;
-            }
-        }
-
+        Peer *u = findPeer(Q.begin()->second);
         // Remove u from Q
-        Q.erase(u->hostname);
+        Q.erase(Q.begin());
 
         for (const auto &neighborHostname : u->neighbors) {
-            auto neighbor = getPeer(neighborHostname);
-            if (u->distance + 1 < neighbor->distance) {
-                neighbor->distance = u->distance + 1;
+            auto neighbor = findPeer(neighborHostname);
+            if (neighbor == nullptr) continue;
+            int distance = u->distance + getLinkWeight(u->hostname, neighborHostname);
+            if (distance < neighbor->distance) {
+                Q.erase({neighbor->distance, neighbor->hostname});
+                neighbor->distance = distance;
                 neighbor->previous = u->hostname;
+                // the next hop is inherited from the previous peer, except for neighbors of the center
+                neighbor->nextHop = u->hostname == centerPeer ? neighbor->hostname : u->nextHop;
+                Q.emplace(neighbor->distance, neighbor->hostname);
             }
         }
     }
 
-    // update next hops for each peer
-    for (auto &peer: peers) {
-        // unreachable nodes
-        if (peer.distance == INT32_MAX - 1) {
-            peer.previous = "";
-            peer.nextHop = "";
-            continue;
+    // the start node is its own next hop
+    center->nextHop = centerPeer;
+}
+
+/**
+ * Calculate the loop free next hops for all peers. Requires the distances of calculateNextHops.
+ * A neighbor is a loop free alternative, if its shortest path to the target does not lead over the center peer.
+ * Neighbors that are closer to the target than the center peer share the load, because every hop of their path
+ * gets closer to the target and thus no loop can occur, even if every peer spreads its flows.
+ */
+void Topology::calculateAlternativeNextHops() {
+    auto center = findPeer(centerPeer);
+    if (center == nullptr) return;
+
+    // distances from every neighbor of the center peer to all peers
+    std::map<std::string, std::map<std::string, int>> neighborDistances;
+    for (const auto &neighbor : center->neighbors) {
+        neighborDistances.emplace(neighbor, calculateDistances(neighbor));
+    }
+
+    for (auto &item : peers) {
+        auto &peer = item.second;
+        peer.nextHops.clear();
+        peer.multipathCount = 0;
+        if (peer.nextHop.empty() || peer.hostname == centerPeer) continue;
+
+        // cost of the path and the next hop
+        std::vector<std::pair<int, std::string>> multipaths, alternatives;
+        for (const auto &distances : neighborDistances) {
+            auto distance = distances.second.find(peer.hostname);
+            auto centerDistance = distances.second.find(centerPeer);
+            if (distance == distances.second.end() || centerDistance == distances.second.end()) continue;
+            // the neighbor would route back over the center peer
+            if (distance->second >= centerDistance->second + peer.distance) continue;
+
+            int cost = getLinkWeight(centerPeer, distances.first) + distance->second;
+            if (distance->second < peer.distance && cost <= peer.distance * (1 + MULTIPATH_STRETCH))
+                multipaths.emplace_back(cost, distances.first);
+            else
+                alternatives.emplace_back(cost, distances.first);
         }
-        // if start node or neighbor
-        if (peer.previous.empty() || peer.previous == centerPeer) {
-            peer.nextHop = peer.hostname;
-            continue;
+        std::sort(multipaths.begin(), multipaths.end());
+        std::sort(alternatives.begin(), alternatives.end());
+
+        for (const auto &path : multipaths) peer.nextHops.push_back(path.second);
+        for (const auto &path : alternatives) peer.nextHops.push_back(path.second);
+        peer.multipathCount = multipaths.size();
+    }
+}
+
+/**
+ * Calculate the distance of the shortest path from a peer to all other peers.
+ * @param start hostname of the start peer
+ * @param previous optional map that is filled with the previous peer on the shortest path by hostname
+ * @return distance by hostname, unreachable peers are missing
+ */
+std::map<std::string, int> Topology::calculateDistances(const std::string &start,
+                                                        std::map<std::string, std::string> *previous) {
+    std::map<std::string, int> distances;
+    // queue ordered by distance and hostname
+    std::set<std::pair<int, std::string>> Q;
+    distances.emplace(start, 0);
+    Q.emplace(0, start);
+
+    while (!Q.empty()) {
+        auto u = *Q.begin();
+        Q.erase(Q.begin());
+        auto peer = findPeer(u.second);
+        if (peer == nullptr) continue;
+
+        for (const auto &neighborHostname : peer->neighbors) {
+            int distance = u.first + getLinkWeight(u.second, neighborHostname);
+            auto neighborDistance = distances.find(neighborHostname);
+            if (neighborDistance != distances.end() && neighborDistance->second <= distance) continue;
+            if (neighborDistance != distances.end()) {
+                Q.erase({neighborDistance->second, neighborHostname});
+                neighborDistance->second = distance;
+            } else {
+                distances.emplace(neighborHostname, distance);
+            }
+            if (previous != nullptr) (*previous)[neighborHostname] = u.second;
+            Q.emplace(distance, neighborHostname);
         }
+    }
+    return distances;
+}
 
-        auto previous = getPeer(peer.previous);
-        while (previous != nullptr && previous->previous != centerPeer) {
-            previous = getPeer(previous->previous);
+/**
+ * Calculate the neighbors of the center peer in the distribution tree of a group.
+ * The tree is shared by all senders: it is the union of the shortest paths from the alphabetical first member
+ * to all other members. Every peer calculates the same tree, thus a message forwarded along the tree edges
+ * reaches every member exactly once. A peer that is not part of the tree sends towards the root.
+ * @param members hostnames of the group members
+ * @return hostnames of the neighbors in the tree
+ */
+std::set<std::string> Topology::calculateTreeNeighbors(const std::set<std::string> &members) {
+    std::set<std::string> treeNeighbors;
+    if (members.empty()) return treeNeighbors;
+    const auto &root = *members.begin();
+
+    std::map<std::string, std::string> previous;
+    calculateDistances(root, &previous);
+
+    // walk from every member up to the root and collect the edges at the center peer
+    std::set<std::string> treePeers{root};
+    for (const auto &member : members) {
+        std::string current = member;
+        while (treePeers.insert(current).second) {
+            auto parent = previous.find(current);
+            // member is unreachable
+            if (parent == previous.end()) break;
+            if (current == centerPeer) treeNeighbors.insert(parent->second);
+            if (parent->second == centerPeer) treeNeighbors.insert(current);
+            current = parent->second;
         }
-        peer.nextHop = previous != nullptr ? previous->hostname : "";
     }
+
+    if (treePeers.find(centerPeer) == treePeers.end()) {
+        auto rootPeer = getPeer(root);
+        if (rootPeer != nullptr && !rootPeer->nextHop.empty()) treeNeighbors.insert(rootPeer->nextHop);
+    }
+    treeNeighbors.erase(centerPeer);
+    return treeNeighbors;
 }
 
 /**
  * Calculate the peers that should connect to a new peer.
- * @return Vector of one or two hostnames that should connect
+ * As long as the network is small, every peer with a free connection connects to the new peer.
+ * Afterwards the new peer splits up MAX_NEIGHBORS / 2 pseudo-random connections (u, v) into (u, new) and (new, v).
+ * This keeps the degree of all peers bounded and the network close to a random regular graph,
+ * which has a diameter of O(log N). Every peer calculates the same result for the same new peer.
+ * @param newPeer identification of the new peer, which is the same on all peers (e.g. its ip)
+ * @return peers that should connect to the new peer and the connections they have to remove
  */
-std::vector<std::string> Topology::calculateBridgePeer() {
-    std::vector<std::string> bridgePeers;
-    if (peers.empty()) return bridgePeers;
+Topology::Bridge Topology::calculateBridgePeer(const std::string &newPeer) {
+    Bridge bridge;
+    if (degreeIndex.empty()) return bridge;
+
+    std::set<std::string> usedPeers;
+    if (peers.size() > MAX_NEIGHBORS) {
+        std::mt19937_64 random(hashString(newPeer));
+        for (int attempt = 0; attempt < 16 * MAX_NEIGHBORS && usedPeers.size() < MAX_NEIGHBORS; ++attempt) {
+            // random peer and a random connection of it
+            const auto &peer = peers.find(hostnames[random() % hostnames.size()])->second;
+            if (peer.neighbors.empty() || usedPeers.count(peer.hostname)) continue;
+            const auto &neighbor = *std::next(peer.neighbors.begin(), random() % peer.neighbors.size());
+            if (usedPeers.count(neighbor)) continue;
+
+            bridge.replacedConnections.push_back({peer.hostname, neighbor});
+            bridge.peers.push_back(peer.hostname);
+            bridge.peers.push_back(neighbor);
+            usedPeers.insert(peer.hostname);
+            usedPeers.insert(neighbor);
+        }
+    }
+
+    // small networks or no fitting connections found: connect the least connected peers with a free connection
+    // the index is sorted by count of neighbors and hostname
+    for (const auto &entry : degreeIndex) {
+        if (usedPeers.size() >= MAX_NEIGHBORS || entry.first >= MAX_NEIGHBORS) break;
+        if (!usedPeers.insert(entry.second).second) continue;
+        bridge.peers.push_back(entry.second);
+    }
 
-    auto peersCopy = peers;
-    // sort by count of neighbors and hostname
-    sortByNeighborsAndName(peersCopy);
+    return bridge;
+}
 
-    bridgePeers.push_back(peersCopy.at(0).hostname);
+/**
+ * Calculate the new connections between the former neighbors of a peer that left the network.
+ * Former neighbors are paired up, so every one of them gets back the lost connection.
+ * @param formerNeighbors neighbors of the peer that left. The peer has to be removed already
+ * @return pairs of peers that should connect. The first peer of a pair builds the connection
+ */
+std::vector<std::array<std::string, 2>>
+Topology::calculateLeaveRepair(const std::set<std::string> &formerNeighbors) {
+    std::vector<std::array<std::string, 2>> repairConnections;
+
+    std::vector<std::string> unpaired;
+    for (const auto &hostname : formerNeighbors) {
+        auto peer = findPeer(hostname);
+        if (peer != nullptr && peer->neighbors.size() < MAX_NEIGHBORS) unpaired.push_back(hostname);
+    }
 
-    // when a fifth peer connects, we need two connections
-    if (peers.size() >= 4) bridgePeers.push_back(peersCopy.at(1).hostname);
+    // the former neighbors are sorted by hostname, so every peer builds the same pairs
+    while (unpaired.size() >= 2) {
+        auto first = unpaired.front();
+        unpaired.erase(unpaired.begin());
+        auto peer = findPeer(first);
+        auto second = std::find_if(unpaired.begin(), unpaired.end(), [&peer](const std::string &hostname) {
+            return peer->neighbors.find(hostname) == peer->neighbors.end();
+        });
+        if (second == unpaired.end()) continue;
+
+        repairConnections.push_back({first, *second});
+        unpaired.erase(second);
+    }
 
-    return bridgePeers;
+    return repairConnections;
 }
 
 /**
  * Check if the network is fractured into parts.
  * @return true: a unreachable peer exists
  */
-bool Topology::isFractured() const {
-    return std::any_of(peers.begin(), peers.end(), [](const Peer &peer) { return peer.nextHop.empty(); });
+bool Topology::isFractured() {
+    updateRoutes();
+    return std::any_of(peers.begin(), peers.end(),
+                       [](const std::pair<const std::string, Peer> &item) { return item.second.nextHop.empty(); });
 }
 
 /**
- * Calculate the hostnames to which the center peer should connect after a fracture happens.
- * @param startingPeers used for recursive calls to stay in the same reachable peers
- * @return vector of the hostnames
+ * Label every peer with the id of its connected component.
+ * @return count of components
  */
-std::vector<std::string> Topology::calculateNewConnections(const std::set<std::string> &startingPeers) {
-    std::vector<std::string> newConnectionTargets;
-
-    // get the reachable nodes
-    std::vector<Peer> reachablePeers;
-    std::vector<Peer> unreachablePeers;
-    for (const auto &peer : peers) {
-        if (peer.nextHop.empty()) {
-            unreachablePeers.push_back(peer);
-        } else if (startingPeers.empty()) {
-            reachablePeers.push_back(peer);
-        } else if (startingPeers.find(peer.hostname) != startingPeers.end()) {
-            reachablePeers.push_back(peer);
+int Topology::labelComponents() {
+    for (auto &item : peers) item.second.component = -1;
+
+    int componentCount = 0;
+    std::vector<Peer *> stack;
+    for (auto &item : peers) {
+        if (item.second.component != -1) continue;
+
+        // depth first search over all peers reachable from this one
+        item.second.component = componentCount;
+        stack.push_back(&item.second);
+        while (!stack.empty()) {
+            auto peer = stack.back();
+            stack.pop_back();
+            for (const auto &neighborHostname : peer->neighbors) {
+                auto neighbor = findPeer(neighborHostname);
+                if (neighbor == nullptr || neighbor->component != -1) continue;
+                neighbor->component = componentCount;
+                stack.push_back(neighbor);
+            }
         }
+        componentCount++;
     }
+    return componentCount;
+}
 
-    auto peersCopy = peers;
-    // sort by hostname
-    std::sort(peersCopy.begin(), peersCopy.end(),
-              [](const Peer &peer1, const Peer &peer2) { return peer1.hostname < peer2.hostname; });
-
-    // group with the lowest peer connected builds new connections
-    auto currentPeerIt = std::find_if(reachablePeers.begin(), reachablePeers.end(),
-                                      [&peersCopy](const Peer &peer) {
-                                          return peer.hostname == peersCopy.at(0).hostname;
-                                      });
-    if (currentPeerIt == reachablePeers.end()) return newConnectionTargets;
-
-    // sort reachable and unreachable peers by hostname and count of neighbor
-    sortByNeighborsAndName(reachablePeers);
-    sortByNeighborsAndName(unreachablePeers);
-
-    auto firstReachablePeer = reachablePeers.at(0).hostname;
-    auto firstUnreachablePeer = unreachablePeers.at(0).hostname;
-    // try a new connection between the first reachable peer and the first unreachable
-    setConnection(firstReachablePeer, firstUnreachablePeer, true);
-    if (centerPeer == firstReachablePeer) {
-        newConnectionTargets.push_back(firstUnreachablePeer);
+/**
+ * Calculate the hostnames to which the center peer should connect after a fracture happens.
+ * The component containing the alphabetical lowest peer builds one connection to every other component.
+ * Each connection is built by its currently least connected peer to the least connected peer of the other component.
+ * @return vector of the hostnames
+ */
+std::vector<std::string> Topology::calculateNewConnections() {
+    std::vector<std::string> newConnectionTargets;
+    if (peers.empty()) return newConnectionTargets;
+
+    int componentCount = labelComponents();
+    if (componentCount < 2) return newConnectionTargets;
+
+    // peers are sorted by hostname, thus the first one is in the component that builds the new connections
+    int mainComponent = peers.begin()->second.component;
+    auto center = findPeer(centerPeer);
+    if (center == nullptr || center->component != mainComponent) return newConnectionTargets;
+
+    // peers of the main component and the first peer of every other component,
+    // each ordered by count of neighbors and hostname
+    std::set<std::pair<size_t, std::string>> bridgePeers;
+    std::vector<std::pair<size_t, std::string>> componentPeers(componentCount, {SIZE_MAX, ""});
+    for (const auto &item : peers) {
+        const auto &peer = item.second;
+        std::pair<size_t, std::string> key(peer.neighbors.size(), peer.hostname);
+        if (peer.component == mainComponent) bridgePeers.insert(key);
+        else if (key < componentPeers[peer.component]) componentPeers[peer.component] = key;
     }
-    // check if it is still fractured -> this happens if the network is fractured into three groups
-    if (isFractured()) {
-        // recursive call
-        std::set<std::string> reachableHostnames;
-        for (const auto &peer : reachablePeers) {
-            reachableHostnames.insert(peer.hostname);
+    componentPeers.erase(componentPeers.begin() + mainComponent);
+    std::sort(componentPeers.begin(), componentPeers.end());
+
+    for (const auto &target : componentPeers) {
+        // take the least connected peer of the main component and count its new connection
+        auto bridgePeer = *bridgePeers.begin();
+        bridgePeers.erase(bridgePeers.begin());
+        if (bridgePeer.second == centerPeer) {
+            newConnectionTargets.push_back(target.second);
         }
-        auto secondsNewConnections = calculateNewConnections(reachableHostnames);
-        newConnectionTargets.insert(newConnectionTargets.end(), secondsNewConnections.begin(),
-                                    secondsNewConnections.end());
+        bridgePeer.first++;
+        bridgePeers.insert(bridgePeer);
     }
 
-    // reset the connection
-    setConnection(firstReachablePeer, firstUnreachablePeer, false);
-
     return newConnectionTargets;
 }
 
@@ -363,7 +673,9 @@ std::vector<std::string> Topology::calculateNewConnections(const std::set<std::s
  */
 bool Topology::isUnderconnected() const {
     if (peers.size() < 5) return false;
-    return std::any_of(peers.begin(), peers.end(), [](const Peer &peer) { return peer.neighbors.size() == 1; });
+    // first peer with at least one neighbor
+    auto peer = degreeIndex.lower_bound({1, ""});
+    return peer != degreeIndex.end() && peer->first == 1;
 }
 
 /**
@@ -371,29 +683,10 @@ bool Topology::isUnderconnected() const {
  * @return hostname
  */
 std::string Topology::calculateNewUnderconnections() {
-    auto peersCopy = peers;
-    sortByNeighborsAndName(peersCopy);
+    if (degreeIndex.size() < 2) return "";
 
     // second peer should connect to the first one
-    if (peersCopy.at(1).hostname == centerPeer) return peersCopy.at(0).hostname;
+    auto firstPeer = degreeIndex.begin();
+    if (std::next(firstPeer)->second == centerPeer) return firstPeer->second;
     return "";
 }
-
-/**
- * Sort the passed vector ascending by the count of neighbors and the hostname.
- * @param sortPeers
- */
-void Topology::sortByNeighborsAndName(std::vector<Peer> &sortPeers) {
-    std::sort(sortPeers.begin(), sortPeers.end(),
-              [](const Peer &peer1, const Peer &peer2) {
-                  auto size1 = peer1.neighbors.size();
-                  auto size2 = peer2.neighbors.size();
-                  if (size1 < size2) {
-                      return true;
-                  }
-                  if (size1 == size2) {
-                      return peer1.hostname < peer2.hostname;
-                  }
-                  return false;
-              });
-}
\ No newline at end of file
@@ -5,20 +5,41 @@
 #include <list>
 #include <vector>
 #include <set>
+#include <map>
+#include <array>
 
 using json = nlohmann::json;
 
+// every peer is connected to at most this many other peers. Must be even to keep the degree on joins.
+#define MAX_NEIGHBORS 4
+// weight of a connection in microseconds until a latency was measured
+#define DEFAULT_LINK_WEIGHT 1000
+// paths that cost up to this much more than the best one share the load of a destination
+#define MULTIPATH_STRETCH 0.25
+
 class Topology {
 public:
     // Topology Member to prevent the big Client class getting initialized all the time
     struct Peer {
         std::string hostname; // used as identification
         std::string nextHop; // next hop hostname
+        std::vector<std::string> nextHops; // loop free next hops ordered by cost. The first ones share the load
+        size_t multipathCount; // count of next hops that share the load
         std::set<std::string> neighbors; // host names of the neighbors of this peer
+        std::map<std::string, int> linkWeights; // latency to the neighbors measured by this peer in microseconds
 
         // used for Dijkstra
         int distance;
         std::string previous;
+
+        // used for the component labeling
+        int component;
+    };
+
+    // Connections that integrate a new peer into the network
+    struct Bridge {
+        std::vector<std::string> peers; // peers that connect to the new peer. The first one sends the network data
+        std::vector<std::array<std::string, 2>> replacedConnections; // connections split up by the new peer
     };
 
     explicit Topology(const std::string &centerPeer);
@@ -28,27 +49,46 @@ public:
     int getPeerCount();
     void removePeer(const std::string &hostname);
     void setConnection(const std::string &hostname1, const std::string &hostname2, bool connected);
-    bool isFractured() const;
+    bool setLinkWeight(const std::string &hostname, const std::string &neighbor, int weight);
+    int getLinkWeight(const std::string &hostname, const std::string &neighbor);
+    bool isFractured();
     bool isUnderconnected() const;
     Peer *getPeer(const std::string &hostname);
+    std::string getNextHop(const std::string &hostname, const std::string &flow,
+                           const std::set<std::string> &availableHops);
+    std::set<std::string> getNeighbors(const std::string &hostname);
+    std::set<std::string> calculateTreeNeighbors(const std::set<std::string> &members);
     void plot();
     std::vector<std::string> getShortestPath(const std::string &hostname);
     std::map<std::string, std::string> getRoutingTable();
     void loadJson(const json &j);
     json toJson();
-    std::vector<std::string> calculateBridgePeer();
-    std::vector<std::string>
-    calculateNewConnections(const std::set<std::string> &startingPeers = std::set<std::string>());
+    Bridge calculateBridgePeer(const std::string &newPeer);
+    std::vector<std::array<std::string, 2>> calculateLeaveRepair(const std::set<std::string> &formerNeighbors);
+    std::vector<std::string> calculateNewConnections();
     std::string calculateNewUnderconnections();
 
+    // getter
+    unsigned long getVersion() const { return version; }
+
 private:
     // fields
-    std::vector<Topology::Peer> peers;
+    std::map<std::string, Topology::Peer> peers; // peers by hostname
+    // hostnames of the peers for random access. Sorted like peers, thus every peer picks the same random ones
+    std::vector<std::string> hostnames;
+    std::set<std::pair<size_t, std::string>> degreeIndex; // peers ordered by count of neighbors and hostname
     std::string centerPeer; // the hostname of the peer this Topology is running on
+    bool routesOutdated = true; // next hops are only recalculated when they are needed
+    unsigned long version = 0; // increased on every change, used to invalidate calculations based on the topology
 
     // methods
+    Peer *findPeer(const std::string &hostname);
+    void updateRoutes();
     void calculateNextHops();
-    static void sortByNeighborsAndName(std::vector<Peer> &sortPeers);
+    void calculateAlternativeNextHops();
+    std::map<std::string, int> calculateDistances(const std::string &start,
+                                                  std::map<std::string, std::string> *previous = nullptr);
+    int labelComponents();
 };
 
 
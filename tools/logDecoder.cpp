@@ -0,0 +1,59 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <src/BinaryLog.h>
+
+/**
+ * Expands a binary log of the client into text, oldest trace first.
+ * The formats are read from the file, thus it can be decoded by another build.
+ *
+ * Usage: ./logDecoder FILE
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " FILE" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    BinaryLogHeader header{};
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        memcmp(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic)) != 0 ||
+        header.recordSize != sizeof(BinaryLogRecord) || header.capacity == 0) {
+        std::cerr << "'" << argv[1] << "' is no binary log of this version." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<const char *> formats;
+    header.formats[sizeof(header.formats) - 1] = '\0';
+    for (size_t offset = 0; formats.size() < header.formatCount && offset < sizeof(header.formats);
+         offset += strlen(header.formats + offset) + 1) {
+        formats.push_back(header.formats + offset);
+    }
+
+    // the ring starts with the oldest record once it wrapped around
+    const uint64_t first = header.written > header.capacity ? header.written - header.capacity : 0;
+    if (first > 0) std::cout << first << " older traces were overwritten." << std::endl;
+    if (header.dropped > 0) {
+        std::cout << header.dropped << " traces were dropped while the queue was full." << std::endl;
+    }
+
+    BinaryLogRecord record{};
+    for (uint64_t i = first; i < header.written; ++i) {
+        file.seekg(sizeof(header) + (i % header.capacity) * sizeof(record));
+        if (!file.read(reinterpret_cast<char *>(&record), sizeof(record))) break;
+
+        const time_t seconds = record.timestamp / 1000000000;
+        struct tm time{};
+        char buffer[32];
+        localtime_r(&seconds, &time);
+        strftime(buffer, sizeof(buffer), "%F %T", &time);
+        std::cout << "[" << buffer << "." << std::setfill('0') << std::setw(6) << record.timestamp / 1000 % 1000000
+                  << "] " << (record.format < formats.size() ? BinaryLog::decode(record, formats[record.format])
+                                                              : "Unknown trace " + std::to_string(record.format))
+                  << std::endl;
+    }
+    return EXIT_SUCCESS;
+}